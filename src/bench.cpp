@@ -0,0 +1,307 @@
+/**
+ * Headless benchmark of the Custom Layout and Incremental plugins.
+ * Runs every (dataset, preset, thread count) combination several times and reports one record per run:
+ * wall time, iterations done and the stress of the final layout, as CSV or JSON.
+ *
+ * Usage: bench [options]
+ *   --data <dir>            Directory of the datasets (default: ../dataset)
+ *   --dataset <name>        Dataset to run, without the .json extension. Repeatable (default: n100 ... n4000, incremental*).
+ *                           The datasets whose name starts with "incremental" are timelines and run Incremental, the others run Custom Layout
+ *   --preset <name>         Parameter preset to run, see PRESETS. Repeatable (default: default)
+ *   --reps <n>              Number of repetitions of each run (default: 3)
+ *   --threads <t1,t2,...>   Thread counts to run with (default: the OpenMP default)
+ *   --format <csv|json>     Output format (default: csv)
+ *   --output <file>         Output file (default: standard output)
+ *   --no-stress             Do not compute the stress, which is quadratic in the number of nodes
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <queue>
+#include <string>
+#include <cstdlib>
+
+#include <tulip/TlpTools.h>
+#include <tulip/Graph.h>
+#include <tulip/ForEach.h>
+#include <tulip/DataSet.h>
+#include <tulip/LayoutProperty.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+struct Preset {
+    std::string name;
+    std::vector<std::string> flags; // Boolean parameters set to true, the others keep their default value
+};
+
+const std::vector<Preset> PRESETS = {
+    {"default", {}},
+    {"stopping", {"stopping criterion"}},
+    {"adaptive", {"adaptive cooling", "stopping criterion"}},
+    {"multipole", {"multipole expansion"}},
+    {"fmm", {"fast multipole method"}},
+    {"multilevel", {"multilevel"}},
+    {"cutoff", {"cutoff repulsion"}},
+    {"active", {"active set", "stopping criterion"}},
+    {"refinement", {"refinement"}},
+    {"double", {"double precision"}},
+    {"fmm-double", {"fast multipole method", "double precision"}},
+    {"components", {"layout components"}},
+    {"pinned", {"pin threads"}},
+    {"lists", {"interaction lists"}},
+    {"reordered", {"reorder nodes"}},
+};
+
+const std::vector<std::string> DEFAULT_DATASETS = {"n100", "n300", "n1000", "n2000", "n4000", "incremental", "incremental2", "incremental3"};
+const float IDEAL_EDGE_LENGTH = 10.0f; // Default "ideal edge length" of the plugins
+
+struct Record {
+    std::string dataset;
+    std::string algorithm;
+    std::string preset;
+    unsigned int threads;
+    unsigned int rep;
+    unsigned int nodes;
+    unsigned int edges;
+    double wallTime;
+    unsigned int iterations;
+    double stress;
+};
+
+/**
+ * @brief Normalized stress of the layout of g: sum over the connected pairs of ((s * |pi - pj| - L * dij) / (L * dij))^2, divided by the number of pairs,
+ * where dij is the graph distance and s the scale that minimizes the sum. 0 is a perfect layout, and the value does not depend on the layout's scale.
+ */
+double computeStress(tlp::Graph *g, tlp::LayoutProperty *layout) {
+    const std::vector<tlp::node> &nodes = g->nodes();
+    unsigned int nbNodes = nodes.size();
+    std::vector<std::vector<unsigned int>> adj(nbNodes);
+    for (auto e : g->edges()) {
+        unsigned int u = g->nodePos(g->source(e));
+        unsigned int v = g->nodePos(g->target(e));
+        adj[u].push_back(v);
+        adj[v].push_back(u);
+    }
+    std::vector<tlp::Coord> pos(nbNodes);
+    for (unsigned int i = 0; i < nbNodes; ++i)
+        pos[i] = layout->getNodeValue(nodes[i]);
+
+    // with wij = 1 / (L * dij)^2 and xij = |pi - pj|, the optimal scale is sum(wij xij L dij) / sum(wij xij^2)
+    double sumWxx = 0, sumWxd = 0, sumWdd = 0;
+    double nbPairs = 0;
+    #pragma omp parallel for schedule(dynamic, 16) reduction(+:sumWxx, sumWxd, sumWdd, nbPairs)
+    for (unsigned int i = 0; i < nbNodes; ++i) {
+        std::vector<unsigned int> dist(nbNodes, 0);
+        std::queue<unsigned int> queue;
+        queue.push(i);
+        dist[i] = 1; // distances are shifted by one so that 0 means unvisited
+        while (!queue.empty()) {
+            unsigned int u = queue.front();
+            queue.pop();
+            for (unsigned int v : adj[u]) {
+                if (dist[v] == 0) {
+                    dist[v] = dist[u] + 1;
+                    queue.push(v);
+                }
+            }
+        }
+        for (unsigned int j = i + 1; j < nbNodes; ++j) {
+            if (dist[j] == 0)
+                continue;
+            double d = IDEAL_EDGE_LENGTH * (dist[j] - 1);
+            double x = (pos[i] - pos[j]).norm();
+            double w = 1.0 / (d * d);
+            sumWxx += w * x * x;
+            sumWxd += w * x * d;
+            sumWdd += w * d * d;
+            nbPairs += 1;
+        }
+    }
+    if (nbPairs == 0 || sumWxx == 0)
+        return 0;
+    double scale = sumWxd / sumWxx;
+    return (scale * scale * sumWxx - 2 * scale * sumWxd + sumWdd) / nbPairs;
+}
+
+/**
+ * @brief Runs the plugin on a freshly loaded copy of the dataset, only the plugin itself is timed
+ * @return Whether or not the run succeeded
+ */
+bool runOnce(const std::string &path, const Preset &preset, bool stress, Record &record) {
+    tlp::Graph *graph = tlp::loadGraph(path);
+    if (graph == nullptr) {
+        std::cerr << "cannot load " << path << std::endl;
+        return false;
+    }
+    record.nodes = graph->numberOfNodes();
+    record.edges = graph->numberOfEdges();
+
+    tlp::DataSet ds;
+    for (const std::string &flag : preset.flags)
+        ds.set(flag, true);
+
+    std::string errorMessage;
+    bool timeline = record.algorithm == "Incremental";
+    tlp::LayoutProperty *layout = graph->getLocalProperty<tlp::LayoutProperty>("viewLayout");
+    auto start = std::chrono::steady_clock::now();
+    bool ok = timeline ? graph->applyAlgorithm("Incremental", errorMessage, &ds)
+                       : graph->applyPropertyAlgorithm("Custom Layout", layout, errorMessage, nullptr, &ds);
+    record.wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok) {
+        std::cerr << path << " (" << preset.name << "): " << errorMessage << std::endl;
+        delete graph;
+        return false;
+    }
+    record.iterations = 0;
+    ds.get("iterations done", record.iterations);
+
+    // the stress of a timeline is the average stress of its steps
+    record.stress = 0;
+    if (stress && timeline) {
+        tlp::Graph *step;
+        unsigned int nbSteps = 0;
+        forEach (step, graph->getSubGraphs()) {
+            record.stress += computeStress(step, step->getLocalProperty<tlp::LayoutProperty>("viewLayout"));
+            ++nbSteps;
+        }
+        if (nbSteps > 0)
+            record.stress /= nbSteps;
+    } else if (stress) {
+        record.stress = computeStress(graph, layout);
+    }
+    delete graph;
+    return true;
+}
+
+void writeCsv(std::ostream &out, const std::vector<Record> &records) {
+    out << "dataset,algorithm,preset,threads,rep,nodes,edges,wall_time_s,iterations,stress" << std::endl;
+    for (const Record &r : records) {
+        out << r.dataset << "," << r.algorithm << "," << r.preset << "," << r.threads << "," << r.rep << "," << r.nodes << "," << r.edges << "," 
+            << r.wallTime << "," << r.iterations << "," << r.stress << std::endl;
+    }
+}
+
+void writeJson(std::ostream &out, const std::vector<Record> &records) {
+    out << "[" << std::endl;
+    for (unsigned int i = 0; i < records.size(); ++i) {
+        const Record &r = records[i];
+        out << "  {\"dataset\": \"" << r.dataset << "\", \"algorithm\": \"" << r.algorithm << "\", \"preset\": \"" << r.preset 
+            << "\", \"threads\": " << r.threads << ", \"rep\": " << r.rep << ", \"nodes\": " << r.nodes << ", \"edges\": " << r.edges 
+            << ", \"wall_time_s\": " << r.wallTime << ", \"iterations\": " << r.iterations << ", \"stress\": " << r.stress << "}" 
+            << (i + 1 < records.size() ? "," : "") << std::endl;
+    }
+    out << "]" << std::endl;
+}
+
+int usage(const char *name) {
+    std::cerr << "usage: " << name << " [--data <dir>] [--dataset <name>]... [--preset <name>]... [--reps <n>] [--threads <t1,t2,...>] "
+              << "[--format csv|json] [--output <file>] [--no-stress]" << std::endl;
+    std::cerr << "presets:";
+    for (const Preset &preset : PRESETS)
+        std::cerr << " " << preset.name;
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+    std::string dataDir = "../dataset";
+    std::vector<std::string> datasets;
+    std::vector<const Preset *> presets;
+    std::vector<unsigned int> threadCounts;
+    unsigned int reps = 3;
+    std::string format = "csv";
+    std::string outputPath;
+    bool stress = true;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-stress") {
+            stress = false;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return usage(argv[0]);
+        std::string value = argv[++i];
+        if (arg == "--data") {
+            dataDir = value;
+        } else if (arg == "--dataset") {
+            datasets.push_back(value);
+        } else if (arg == "--preset") {
+            const Preset *found = nullptr;
+            for (const Preset &preset : PRESETS) {
+                if (preset.name == value)
+                    found = &preset;
+            }
+            if (found == nullptr)
+                return usage(argv[0]);
+            presets.push_back(found);
+        } else if (arg == "--reps") {
+            reps = std::atoi(value.c_str());
+        } else if (arg == "--threads") {
+            std::stringstream list(value);
+            std::string count;
+            while (std::getline(list, count, ','))
+                threadCounts.push_back(std::atoi(count.c_str()));
+        } else if (arg == "--format" && (value == "csv" || value == "json")) {
+            format = value;
+        } else if (arg == "--output") {
+            outputPath = value;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (datasets.empty())
+        datasets = DEFAULT_DATASETS;
+    if (presets.empty())
+        presets.push_back(&PRESETS[0]);
+    if (threadCounts.empty()) {
+#ifdef _OPENMP
+        threadCounts.push_back(omp_get_max_threads());
+#else
+        threadCounts.push_back(1);
+#endif
+    }
+
+    tlp::initTulipLib();
+
+    std::vector<Record> records;
+    bool failed = false;
+    for (const std::string &dataset : datasets) {
+        std::string path = dataDir + "/" + dataset + ".json";
+        for (const Preset *preset : presets) {
+            for (unsigned int threads : threadCounts) {
+#ifdef _OPENMP
+                omp_set_num_threads(threads);
+#endif
+                for (unsigned int rep = 0; rep < reps; ++rep) {
+                    Record record;
+                    record.dataset = dataset;
+                    record.algorithm = dataset.compare(0, 11, "incremental") == 0 ? "Incremental" : "Custom Layout";
+                    record.preset = preset->name;
+                    record.threads = threads;
+                    record.rep = rep;
+                    if (runOnce(path, *preset, stress, record))
+                        records.push_back(record);
+                    else
+                        failed = true;
+                }
+            }
+        }
+    }
+
+    std::ofstream file;
+    if (!outputPath.empty())
+        file.open(outputPath);
+    std::ostream &out = outputPath.empty() ? std::cout : file;
+    if (format == "json")
+        writeJson(out, records);
+    else
+        writeCsv(out, records);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
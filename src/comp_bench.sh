@@ -0,0 +1 @@
+g++ -Wall bench.cpp -std=c++17 -pedantic -O2 -fopenmp -DNDEBUG `tulip-config --libs --cxxflags` -o bench
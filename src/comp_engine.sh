@@ -0,0 +1 @@
+g++ -Wall -c layout_engine.cpp -std=c++17 -pedantic -O2 -fopenmp -DNDEBUG -o layout_engine.o && ar rcs liblayoutengine.a layout_engine.o
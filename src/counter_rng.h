@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Counter-based pseudo random number generator.
+ * The k-th number of a stream only depends on (seed, stream, k): streams are cheap to create (one per node, thread, or step),
+ * share no state and need no lock, so parallel code using them gives the same results whatever the scheduling.
+ */
+class CounterRng {
+public:
+	CounterRng(uint64_t seed, uint64_t stream) : m_key(mix(seed ^ mix(stream + 0x9E3779B97F4A7C15ULL))), m_counter(0) {}
+
+	/**
+	 * @brief Returns the next 64 random bits of the stream
+	 */
+	uint64_t next() {
+		return mix(m_key + (++m_counter) * 0xD1B54A32D192ED03ULL);
+	}
+
+	/**
+	 * @brief Returns the next number of the stream, uniformly distributed in [0, 1)
+	 */
+	float uniform() {
+		return (next() >> 40) * (1.0f / 16777216.0f);
+	}
+
+private:
+	uint64_t m_key; // Key of the stream, derived from the seed and the stream id
+	uint64_t m_counter; // Number of values drawn from the stream
+
+	/**
+	 * @brief splitmix64 finalizer, a bijective mixing function of 64 bits integers
+	 */
+	static uint64_t mix(uint64_t x) {
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		return x ^ (x >> 31);
+	}
+};
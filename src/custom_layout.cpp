@@ -1,5 +1,3 @@
-#define _USE_MATH_DEFINES
-
 #include "custom_layout.h"
 
 #include <tulip/BoundingBox.h>
@@ -12,52 +10,36 @@
 #include <tulip/BooleanProperty.h>	
 #include <tulip/ColorProperty.h>
 
-#include <cstdlib>
 #include <cmath>
-#include <algorithm>
-#include <chrono>
+#include <mutex>
 
-const float DEFAULT_L = 10.0f;
-const float DEFAULT_KR = 100.0f;
-const float DEFAULT_KS = 1.0f;
-const float DEFAULT_INIT_TEMP = 200.0f;
-const float DEFAULT_INIT_TEMP_FACTOR = 0.2f;
-const float DEFAULT_COOLING_FACTOR = 0.95f;
-const float DEFAULT_THRESHOLD = 0.1f;
-const float DEFAULT_MAX_DISP = 200.0f;
-const float DEFAULT_HIGH_ENERGY_THRESHOlD = 1.0f;
-const float DEFAULT_CENTER_ATTR_FACTOR = 0.000001f;
-const float MULTIPOLE_EXPANSION_FACTOR = 100.0f;
-const unsigned int DEFAULT_REFINEMENT_ITERATIONS = 20;
-const unsigned int DEFAULT_REFINEMENT_FREQ = 30;
-const unsigned int DEFAULT_MAX_PARTITION_SIZE = 4;
-const unsigned int DEFAULT_PTERM = 4;
-const unsigned int DEFAULT_ITERATIONS = 300;
 const unsigned int DEFAULT_GRIDX = 50;
 const unsigned int DEFAULT_GRIDY = 50;
 
-const float fPI_6 = M_PI / 6.0f;
-const float f2_PI_6 = 2.0f * fPI_6;
-const float f3_PI_6 = 3.0f * fPI_6;
-const float f4_PI_6 = 4.0f * fPI_6;
-
 PLUGIN(CustomLayout)
 
 CustomLayout::CustomLayout(const tlp::PluginContext *context) 
-	: LayoutAlgorithm(context), m_L(DEFAULT_L), m_Kr(DEFAULT_KR), m_Ks(DEFAULT_KS),
-	  m_initTemp(DEFAULT_INIT_TEMP), m_initTempFactor(DEFAULT_INIT_TEMP_FACTOR), m_coolingFactor(DEFAULT_COOLING_FACTOR), m_threshold(DEFAULT_THRESHOLD), m_maxDisp(DEFAULT_MAX_DISP), 
-	  m_highEnergyThreshold(DEFAULT_HIGH_ENERGY_THRESHOlD), m_centerAttrFactor(DEFAULT_CENTER_ATTR_FACTOR), m_iterations(DEFAULT_ITERATIONS), m_refinementIterations(DEFAULT_REFINEMENT_ITERATIONS), m_refinementFreq(DEFAULT_REFINEMENT_FREQ),
-	  m_maxPartitionSize(DEFAULT_MAX_PARTITION_SIZE), m_pTerm(DEFAULT_PTERM), m_gridX(DEFAULT_GRIDX), m_gridY(DEFAULT_GRIDY) {
+	: LayoutAlgorithm(context), m_measureError(false), m_doublePrecision(false), m_gridX(DEFAULT_GRIDX), m_gridY(DEFAULT_GRIDY) {
 	addInParameter<bool>("adaptive cooling", "If true, the algo uses a local cooling function based on the angle between each node's movement. Else it uses a global linear cooling function.", "", false);
 	addInParameter<bool>("stopping criterion", "If true, stops the algo before the maximum number of iterations if the graph has converged. See \"convergence threshold\"", "", false);
-	addInParameter<bool>("multipole expansion", "If true, apply a 4-term multipole expansion for more accurate layout. May affect performances.", "", false);
+	addInParameter<bool>("multipole expansion", "If true, apply a multipole expansion of \"p-term\" terms for more accurate layout. May affect performances.", "", false);
+	addInParameter<bool>("fast multipole method", "If true, the repulsive forces are computed cell to cell with the Fast Multipole Method (translation of the multipole expansions into local expansions), in linear time. Takes precedence over \"multipole expansion\".", "", false);
+	addInParameter<bool>("cutoff repulsion", "If true, a node is only repulsed by the nodes closer than about \"cutoff radius\", found with a uniform grid instead of the kd-tree. Linear time, but the far nodes are ignored: use it when the global shape is already set (refinement, incremental steps). Takes precedence over \"fast multipole method\".", "", false);
+	addInParameter<bool>("interaction lists", "If true, the repulsive forces of the kd-tree are computed leaf by leaf: each leaf lists the leaves and cells that interact with all its nodes, and the lists are reused until the kd-tree is rebuilt. Ignored if \"fast multipole method\" or \"cutoff repulsion\" is true", "", false);
 	addInParameter<bool>("block nodes", "If true, only nodes in the set \"movable nodes\" will move.", "", false);
 	addInParameter<bool>("refinement", "", "", false);	
-	addInParameter<bool>("pack connected components", "", "true", false);	
+	addInParameter<bool>("layout components", "If true, each connected component is laid out on its own (the small ones concurrently) instead of being attracted toward the center. See \"pack connected components\"", "", false);
+	addInParameter<bool>("pack connected components", "If true, the components laid out on their own are packed into rows, separated by the ideal edge length. The components with blocked nodes do not move. Only taken into account if \"layout components\" is true", "true", false);
+	addInParameter<bool>("active set", "If true, the nodes that stayed at rest for \"rest iterations\" iterations are frozen and skipped, until a neighbour or a close node moves more than \"wake threshold\".", "", false);
+	addInParameter<bool>("multilevel", "If true, the graph is coarsened into a hierarchy of smaller graphs. The coarsest one is laid out first, and its layout is interpolated and refined level by level. Much faster on large graphs.", "", false);
 	addInParameter<unsigned int>("max iterations", "The maximum number of iterations of the algorithm.", "300", false);
-	addInParameter<unsigned int>("max displacement", "The maximum length a node can move. Very high values or very low values may result in chaotic behavior.", "200", false);
+	addInParameter<unsigned int>("multilevel iterations", "The maximum number of iterations on each level of the multilevel hierarchy but the coarsest one, which uses \"max iterations\". Only taken into account if \"multilevel\" is true", "50", false);
+	addInParameter<float>("max displacement", "The maximum length a node can move. Very high values or very low values may result in chaotic behavior.", "200", false);
 	addInParameter<unsigned int>("refinement iterations", "", "20", false);
 	addInParameter<unsigned int>("refinement frequency", "", "30", false);	
+	addInParameter<unsigned int>("rest iterations", "Number of consecutive iterations at rest after which a node is frozen. Only taken into account if \"active set\" is true", "10", false);
+	addInParameter<unsigned int>("p-term", "Number of terms of the multipole expansions (between 1 and 16). More terms are more precise and slower. Only taken into account if \"multipole expansion\" or \"fast multipole method\" is true", "4", false);
+	addInParameter<unsigned int>("seed", "Seed of the random number generators. A given seed and number of threads always give the same layout.", "0", false);
 	addInParameter<unsigned int>("gridX", "", "50", false);
 	addInParameter<unsigned int>("gridY", "", "50", false);	
 	addInParameter<float>("ideal edge length", "The ideal edge length.", "10", false);
@@ -66,15 +48,25 @@ CustomLayout::CustomLayout(const tlp::PluginContext *context)
 	addInParameter<float>("convergence threshold", "If the average node energy is lower than this threshold, the graph is considered to have converged and the algorithm stops. Only taken into consideration if \"stopping criterion\" is true", "0.1", false);
 	addInParameter<float>("high energy threshold", "Threshold above which a node is consired to have a high energy", "1.0", false);	
 	addInParameter<float>("center attraction strength", "Strength of the attraction of nodes toward the center", "0.000001f", false);	
+	addInParameter<float>("cutoff radius", "Size of the cells of the uniform grid, a node is repulsed by the nodes of the 3x3 cells around it. Only taken into account if \"cutoff repulsion\" is true", "30", false);
+	addInParameter<float>("rest threshold", "A node that moves less than this length is at rest. Only taken into account if \"active set\" is true", "0.1", false);
+	addInParameter<float>("wake threshold", "A frozen node is woken up when one of its neighbours or a node close to it moves more than this length. Only taken into account if \"active set\" is true", "1.0", false);
+	addInParameter<float>("tree rebuild threshold", "The kd-tree is refitted to the new positions at each iteration, and fully rebuilt when the sum of the radii of its leaves, relative to the radius of the root, has grown by more than this factor since the last rebuild.", "1.5", false);
+	addInParameter<unsigned int>("snapshot iterations", "If not 0, the result is updated with the current positions every this many iterations while the layout goes on, at the next progress update. The layout does not wait for the update. Only the finest level of \"multilevel\" is shown.", "0", false);
+	addInParameter<float>("snapshot interval", "If not 0, the result is updated with the current positions every this many seconds while the layout goes on, see \"snapshot iterations\".", "0", false);
+	addInParameter<float>("time budget", "Wall-clock budget of the layout in seconds, 0 for none. When the iterations left do not fit in the remaining time, the cooling is sped up so that the layout is still annealed, and the layout is returned when the budget runs out.", "0", false);
+	addInParameter<float>("theta", "Opening criterion of the kd-tree (between 0 excluded and 1): a cell is approximated if its radius is lower than theta times its distance to the node (or to the other cell). Lower values are more precise and slower.", "1.0", false);
+	addInParameter<bool>("measure error", "If true, the repulsive forces at the final positions are compared to the exact O(n^2) summation, and the relative RMS error is returned in \"force error\". Slow on large graphs.", "", false);
+	addInParameter<bool>("double precision", "If true, the positions and the forces are computed in double precision instead of float. Slower and uses twice the memory, but keeps the layout precise when the coordinates span a very large range.", "", false);
+	addInParameter<bool>("reorder nodes", "If true, the nodes are renumbered along a Hilbert curve each time the kd-tree is rebuilt, so that close nodes and the ends of most edges are close in memory. Helps on graphs that do not fit in the CPU caches.", "", false);
+	addInParameter<bool>("pin threads", "If true, each thread is pinned to its own CPU during the layout, the threads being spread evenly over the CPUs (and sockets) allowed. The nodes are renumbered in the kd-tree order each time it is rebuilt, so that each thread processes whole subtrees, and their arrays are first touched by the pinned threads that process them: on NUMA machines the threads keep working on local memory. Pinning is Linux only.", "", false);
+	addInParameter<bool>("profile", "If true, the time spent in each phase of the algo (tree, schedule, repulsion, attraction, update, refinement, export) and counters of the work done are returned in \"profile results\". The refinement time includes the phases of its own iterations.", "", false);
+	addInParameter<std::string>("trace file", "If not empty and \"profile\" is true, the phases of each iteration and its counters are written to this file in the Chrome trace_event format (chrome://tracing, Perfetto).", "", false);
+	addOutParameter<tlp::DataSet>("profile results", "Total time of each phase (\"<phase> time\", in seconds) and counters (tree nodes visited, far-field approximations, leaf pair interactions, nodes moved). Only set if \"profile\" is true.");
+	addOutParameter<double>("force error", "Relative RMS error of the repulsive forces at the final positions: sqrt(sum |F - F_exact|^2 / sum |F_exact|^2). Only set if \"measure error\" is true.");
+	addOutParameter<bool>("stopped early", "True if the layout was stopped before the end, by the time budget or by the user (\"stop\" keeps the current layout, \"cancel\" discards it).");
+	addOutParameter<unsigned int>("iterations done", "Number of iterations done by the algorithm, on all the levels if \"multilevel\" is true (refinement excluded).");
 	addInParameter<tlp::BooleanProperty>("movable nodes", "Set of nodes allowed to move. Only taken into account if \"blocked nodes\" is true", "", false);
-	addDependency("Connected Component Packing (Polyomino)", "1.0");
-	m_cstTemp = false;
-	m_cstInitTemp = false;
-	m_condition = false;
-	m_multipoleExpansion = false;
-	m_adaptiveCooling = false;
-	m_stoppingCriterion = false;
-	m_refinement = false;
 }
 
 CustomLayout::~CustomLayout() {
@@ -92,40 +84,88 @@ bool CustomLayout::check(std::string &errorMessage) {
 bool CustomLayout::run() {
 	if (!init())
 		return false;
+	return m_doublePrecision ? layout<double>() : layout<float>();
+}
 
-	std::cout << "Initial temperature: " << m_temp << std::endl;
-	auto start = std::chrono::high_resolution_clock::now();
-
-	unsigned int it = mainLoop(m_iterations);
+template <typename Real>
+bool CustomLayout::layout() {
+	BasicLayoutEngine<Real> engine(m_params);
+	importGraph(engine);
+	// the properties are not thread-safe: the reader thread of the snapshots only keeps the latest one, 
+	// and this thread writes it to the result when it polls the progress between two iterations
+	std::mutex snapshotMutex;
+	std::vector<Real> pendingX, pendingY, snapshotX, snapshotY;
+	bool pending = false;
+	// the snapshots overwrite the input layout, which is put back if the user cancels
+	std::vector<tlp::Coord> input;
+	if (m_params.snapshotIterations > 0 || m_params.snapshotInterval > 0) {
+		input.reserve(m_nodesCopy.size());
+		for (const tlp::node &n : m_nodesCopy)
+			input.push_back(result->getNodeValue(n));
+	}
+	engine.setSnapshotCallback([&](const std::vector<Real> &x, const std::vector<Real> &y, unsigned int) {
+		std::lock_guard<std::mutex> lock(snapshotMutex);
+		pendingX.assign(x.begin(), x.end());
+		pendingY.assign(y.begin(), y.end());
+		pending = true;
+	});
+	engine.setStopCallback([&](unsigned int done, unsigned int total) {
+		bool write;
+		{
+			std::lock_guard<std::mutex> lock(snapshotMutex);
+			write = pending;
+			if (pending) {
+				snapshotX.swap(pendingX);
+				snapshotY.swap(pendingY);
+				pending = false;
+			}
+		}
+		if (write)
+			writePositions(snapshotX.data(), snapshotY.data());
+		return pluginProgress->progress(done, total) != tlp::TLP_CONTINUE;
+	});
+
+	unsigned int it = engine.run();
+	if (pluginProgress->state() == tlp::TLP_CANCEL) {
+		for (unsigned int i = 0; i < input.size(); ++i)
+			result->setNodeValue(m_nodesCopy[i], input[i]);
+		return false;
+	}
 	
 	// if (!postProcessing()) 
 	// 	return false;
 
 	// update result property
-	#pragma omp parallel for
-	for (unsigned int i = 0; i < graph->numberOfNodes(); ++i) { 
-		result->setNodeValue(m_nodesCopy[i], m_pos[m_nodesCopy[i]]);
-	}
+	Profiler &profiler = engine.profiler();
+	double phase = profiler.begin();
+	exportPositions(engine);
 
 	// add the removed self loops and parallel edges, if they exist
 	for (unsigned int i = 0; i < m_removedEdges.size(); ++i) {
 		graph->addEdge(graph->source(m_removedEdges[i]), graph->target(m_removedEdges[i]));
 	}
 
-	// if (m_packCC && !tlp::ConnectedTest::isConnected(graph)) { // pack connected components
-	// 	std::string errorMessage;
-	// 	tlp::DataSet ds;
-	// 	ds.set("coordinates", result);
-	// 	ds.set("node size", m_size);
-	// 	ds.set("rotation", m_rot);
-	// 	ds.set("margin", 50);
-	// 	graph->applyPropertyAlgorithm("Connected Component Packing (Polyomino)", result, errorMessage, pluginProgress, &ds);
-	// }
+	profiler.end(Profiler::EXPORT, phase);
 
-	auto end = std::chrono::high_resolution_clock::now();
-	std::chrono::duration<double> elapsed = end - start;
-	std::cout << "elapsed: " << elapsed.count() << std::endl;
-	std::cout << "Iterations done: " << it  << std::endl;
+	if (dataSet != nullptr) {
+		dataSet->set("iterations done", it);
+		dataSet->set("stopped early", engine.stopped());
+	}
+	if (m_measureError && dataSet != nullptr)
+		dataSet->set("force error", engine.measureForceError());
+	if (profiler.enabled()) {
+		tlp::DataSet profile;
+		for (unsigned int p = 0; p < Profiler::NB_PHASES; ++p)
+			profile.set(std::string(Profiler::phaseName(Profiler::Phase(p))) + " time", profiler.phaseTime(Profiler::Phase(p)));
+		for (unsigned int c = 0; c < Profiler::NB_COUNTERS; ++c)
+			profile.set(Profiler::counterName(Profiler::Counter(c)), (double)profiler.total(Profiler::Counter(c)));
+		if (dataSet != nullptr)
+			dataSet->set("profile results", profile);
+		if (!m_traceFile.empty() && !profiler.writeTrace(m_traceFile)) {
+			pluginProgress->setError("Cannot write the trace file " + m_traceFile);
+			return false;
+		}
+	}
 
 	return true;
 }
@@ -135,159 +175,180 @@ bool CustomLayout::init() {
 	unsigned int uitemp = 0;
 	int itemp = 0;
 	float ftemp = 0.0f;
+	std::string stemp;
 	tlp::BooleanProperty *temp;
 
 	// receive user's data
 	if (dataSet != nullptr) {
 		if (dataSet->get("max iterations", uitemp))
-			m_iterations = uitemp;
+			m_params.iterations = uitemp;
 		if (dataSet->get("refinement iterations", uitemp))
-			m_refinementIterations = uitemp;
+			m_params.refinementIterations = uitemp;
 		if (dataSet->get("refinement frequency", uitemp))
-			m_refinementFreq = uitemp;
+			m_params.refinementFreq = uitemp;
+		if (dataSet->get("multilevel iterations", uitemp))
+			m_params.multilevelIterations = uitemp;
+		if (dataSet->get("rest iterations", uitemp))
+			m_params.restIterations = uitemp;
+		if (dataSet->get("seed", uitemp))
+			m_params.seed = uitemp;
+		if (dataSet->get("p-term", uitemp))
+			m_params.pTerm = uitemp;
 		if (dataSet->get("gridX", itemp))
 			m_gridX = itemp;
 		if (dataSet->get("gridY", itemp))
 			m_gridY = itemp;
 		if (dataSet->get("max displacement", ftemp))
-			m_maxDisp = uitemp;
+			m_params.maxDisp = ftemp;
 		if (dataSet->get("ideal edge length", ftemp))
-			m_L = ftemp;
+			m_params.idealEdgeLength = ftemp;
 		if (dataSet->get("spring force strength", ftemp))
-			m_Ks = ftemp;
+			m_params.springStrength = ftemp;
 		if (dataSet->get("repulsive force strength", ftemp))
-			m_Kr = ftemp;
+			m_params.repulsiveStrength = ftemp;
 		if (dataSet->get("convergence threshold", ftemp))
-			m_threshold = ftemp;
+			m_params.convergenceThreshold = ftemp;
 		if (dataSet->get("high energy threshold", ftemp))
-			m_highEnergyThreshold = ftemp;
+			m_params.highEnergyThreshold = ftemp;
 		if (dataSet->get("center attraction strength", ftemp))
-			m_centerAttrFactor = ftemp;
+			m_params.centerAttrFactor = ftemp;
+		if (dataSet->get("tree rebuild threshold", ftemp))
+			m_params.rebuildThreshold = ftemp;
+		if (dataSet->get("cutoff radius", ftemp))
+			m_params.cutoffRadius = ftemp;
+		if (dataSet->get("rest threshold", ftemp))
+			m_params.restThreshold = ftemp;
+		if (dataSet->get("wake threshold", ftemp))
+			m_params.wakeThreshold = ftemp;
+		if (dataSet->get("snapshot iterations", uitemp))
+			m_params.snapshotIterations = uitemp;
+		if (dataSet->get("snapshot interval", ftemp))
+			m_params.snapshotInterval = ftemp;
+		if (dataSet->get("time budget", ftemp))
+			m_params.timeBudget = ftemp;
+		if (dataSet->get("theta", ftemp))
+			m_params.theta = ftemp;
 		if (dataSet->get("adaptive cooling", btemp))
-			m_adaptiveCooling = btemp;
+			m_params.adaptiveCooling = btemp;
 		if (dataSet->get("stopping criterion", btemp))
-			m_stoppingCriterion = btemp;
+			m_params.stoppingCriterion = btemp;
 		if (dataSet->get("multipole expansion", btemp))
-			m_multipoleExpansion = btemp;
+			m_params.multipoleExpansion = btemp;
+		if (dataSet->get("fast multipole method", btemp))
+			m_params.fmm = btemp;
+		if (dataSet->get("cutoff repulsion", btemp))
+			m_params.cutoff = btemp;
+		if (dataSet->get("interaction lists", btemp))
+			m_params.interactionLists = btemp;
 		if (dataSet->get("block nodes", btemp))
-			m_condition = btemp;
+			m_params.blockNodes = btemp;
 		if (dataSet->get("refinement", btemp))
-			m_refinement = btemp;
+			m_params.refinement = btemp;
+		if (dataSet->get("multilevel", btemp))
+			m_params.multilevel = btemp;
+		if (dataSet->get("active set", btemp))
+			m_params.activeSet = btemp;
+		if (dataSet->get("reorder nodes", btemp))
+			m_params.reorderNodes = btemp;
+		if (dataSet->get("pin threads", btemp))
+			m_params.pinThreads = btemp;
+		if (dataSet->get("profile", btemp))
+			m_params.profile = btemp;
+		if (dataSet->get("double precision", btemp))
+			m_doublePrecision = btemp;
+		if (dataSet->get("measure error", btemp))
+			m_measureError = btemp;
+		if (dataSet->get("trace file", stemp))
+			m_traceFile = stemp;
+		if (dataSet->get("layout components", btemp))
+			m_params.components = btemp;
+		if (dataSet->get("pack connected components", btemp))
+			m_params.packComponents = btemp;
 		if (dataSet->get("movable nodes", temp))
 			m_canMove = temp;
-		if (dataSet->get("pack connected components", btemp))
-			m_packCC = btemp;
-		else if (m_condition) {
+		else if (m_params.blockNodes) {
 			pluginProgress->setError("\"block nodes\" parameter is true but no BooleanProperty was given. Check parameter \"movable nodes\"");
 			return false;
 		}
 	}
 
-	// initialise hashmaps and temperature
+	if (m_params.pTerm < 1 || m_params.pTerm > MAX_PTERM) {
+		pluginProgress->setError("\"p-term\" must be between 1 and " + std::to_string(MAX_PTERM));
+		return false;
+	}
+	if (!(m_params.theta > 0 && m_params.theta <= 1)) {
+		pluginProgress->setError("\"theta\" must be in ]0, 1]");
+		return false;
+	}
+	if (!(m_params.timeBudget >= 0)) {
+		pluginProgress->setError("\"time budget\" must be positive, or 0 for none");
+		return false;
+	}
+
+	// initialise the result property
 	result->copy(graph->getProperty<tlp::LayoutProperty>("viewLayout"));
 	result->setAllEdgeValue(std::vector<tlp::Vec3f>(0));
 
 	m_size = graph->getLocalProperty<tlp::SizeProperty>("viewSize");
 	m_rot = graph->getLocalProperty<tlp::DoubleProperty>("viewRotation");
 	m_highEnergy = graph->getLocalProperty<tlp::BooleanProperty>("highEnergy");
-
-	tlp::BoundingBox bb = tlp::computeBoundingBox(graph, result, m_size, m_rot);
-	m_temp = m_cstInitTemp ? m_initTemp : std::max(std::min(bb.width(), bb.height()) * m_initTempFactor, 2 * m_L);
-	m_center = bb.center();
-	m_attract = tlp::ConnectedTest::numberOfConnectedComponents(graph) > 1;
-
-	m_nodesCopy = graph->nodes();
-	for (auto n : m_nodesCopy) {
-		m_energy[n] = 0;
-		m_disp[n] = tlp::Coord(0, 0, 0);
-		m_dispPrev[n] = tlp::Coord(0, 0, 0);
-		m_pos[n] = result->getNodeValue(n);
-	}
 	return true;
 }
 
-unsigned int CustomLayout::mainLoop(unsigned int maxIterations) {
-	KNode *kdTree = buildKdTree(false, nullptr);
-	bool quit = false;
-	bool refinement = false;
-	unsigned int it = 1;
-	float totalDisp = 0;
-	float totalEnergy = 0;
-
-	while (!quit) {
-		if (it <= 4 || it % 10 == 0)
-			buildKdTree(true, kdTree); // refresh the kd-tree
-
-		refinement = m_condition && m_refinement && it > 0 && it % m_refinementFreq == 0; // no need to refine if there are no blocked nodes...
-
-		// compute repulsive forces
-		#pragma omp parallel for
-		for (unsigned int i = 0; i < m_nodesCopy.size(); ++i) {
-			if (!m_condition || m_canMove->getNodeValue(m_nodesCopy[i]))
-				computeReplForces(m_nodesCopy[i], kdTree, refinement);
-			if (m_attract) {
-				tlp::Coord dist = m_center - m_pos[m_nodesCopy[i]];
-				float norm = dist.norm();
-				m_disp[m_nodesCopy[i]] += m_centerAttrFactor * dist / (norm * norm);
-			}
-		}
-
-		//compute attractive forces TODO: find a way to parallelize
-		for (auto e : graph->edges()) { 
-			const tlp::node &u = graph->source(e);
-			const tlp::node &v = graph->target(e);
-			tlp::Coord dist = m_pos[u] - m_pos[v];
-			dist *= computeAttrForce(dist);
-			if (!m_condition || m_canMove->getNodeValue(u)) {
-		 		m_disp[u] -= dist;
-				if (refinement)
-					m_energy[u] += computeAttrForceIntgr(dist);
-			}
-			if (!m_condition || m_canMove->getNodeValue(v)) {
-				m_disp[v] += dist;
-				if (refinement)
-					m_energy[v] += computeAttrForceIntgr(dist);				
-			}
-		}
-
-		// update nodes position
-		#pragma omp parallel for
-		for (unsigned int i = 0; i < m_nodesCopy.size(); i++) {
-			const tlp::node &n = m_nodesCopy[i];
-			float dispNorm = m_disp[n].norm();
-			float cooledNorm = dispNorm;
-			if (dispNorm != 0) {  
-				if (m_adaptiveCooling) {
-					cooledNorm = std::min(adaptativeCool(n), m_maxDisp);
-					m_disp[n] *=  cooledNorm / dispNorm;
-				} else if (!m_adaptiveCooling && m_temp < dispNorm) {
-					cooledNorm = m_temp;
-					m_disp[n] *= cooledNorm / dispNorm;
-				}				
-			}
-			if (refinement) totalEnergy += m_energy[n];
-			totalDisp += cooledNorm;
-			m_pos[n] += m_disp[n];
-			m_dispPrev[n] = m_disp[n];
-			m_disp[n] = tlp::Coord(0);
-		}
-
-		// detect convergence
-		if (m_stoppingCriterion && totalDisp <= m_threshold * m_nodesCopy.size()) // m_threshold is relative to the average disp, so we scale it
-			quit = true;
-		totalDisp = 0;
+template <typename Real>
+void CustomLayout::importGraph(BasicLayoutEngine<Real> &engine) {
+	// map the nodes to dense ids and copy their state into contiguous buffers
+	m_nodesCopy = graph->nodes();
+	unsigned int nbNodes = m_nodesCopy.size();
+	std::vector<Real> x(nbNodes), y(nbNodes), width(nbNodes), height(nbNodes);
+	std::vector<char> movable(nbNodes, true);
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		const tlp::node &n = m_nodesCopy[i];
+		const tlp::Coord &pos = result->getNodeValue(n);
+		const tlp::Size &size = m_size->getNodeValue(n);
+		x[i] = pos.x();
+		y[i] = pos.y();
+		width[i] = size.getW();
+		height[i] = size.getH();
+		if (m_params.blockNodes)
+			movable[i] = m_canMove->getNodeValue(n);
+	}
 
-		if (refinement || (quit && m_refinement))
-			computeRefinement(totalEnergy);
+	// build the CSR adjacency, each edge is stored once for both of its extremities
+	std::vector<unsigned int> adjOffsets(nbNodes + 1, 0);
+	std::vector<unsigned int> adjNodes(2 * graph->numberOfEdges());
+	for (auto e : graph->edges()) {
+		++adjOffsets[graph->nodePos(graph->source(e)) + 1];
+		++adjOffsets[graph->nodePos(graph->target(e)) + 1];
+	}
+	for (unsigned int i = 0; i < nbNodes; ++i)
+		adjOffsets[i + 1] += adjOffsets[i];
+	std::vector<unsigned int> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+	for (auto e : graph->edges()) {
+		unsigned int u = graph->nodePos(graph->source(e));
+		unsigned int v = graph->nodePos(graph->target(e));
+		adjNodes[fill[u]++] = v;
+		adjNodes[fill[v]++] = u;
+	}
 
-		if (!m_adaptiveCooling && !m_cstTemp)
-			m_temp *= m_coolingFactor;
+	engine.setGraph(nbNodes, x.data(), y.data(), width.data(), height.data(), adjOffsets.data(), adjNodes.data(), movable.data());
+}
 
-		quit = it > maxIterations || quit;
-		++it;
+template <typename Real>
+void CustomLayout::writePositions(const Real *x, const Real *y) {
+	for (unsigned int i = 0; i < m_nodesCopy.size(); ++i) {
+		tlp::Coord pos = result->getNodeValue(m_nodesCopy[i]);
+		pos.setX(x[i]);
+		pos.setY(y[i]);
+		result->setNodeValue(m_nodesCopy[i], pos);
 	}
-	deleteTree(kdTree);
-	return it;
+}
+
+template <typename Real>
+void CustomLayout::exportPositions(const BasicLayoutEngine<Real> &engine) {
+	writePositions(engine.x().data(), engine.y().data());
+	for (unsigned int i = 0; i < engine.highEnergy().size(); ++i)
+		m_highEnergy->setNodeValue(m_nodesCopy[i], engine.highEnergy()[i]);
 }
 
 bool CustomLayout::postProcessing() {
@@ -303,7 +364,7 @@ bool CustomLayout::postProcessing() {
 	for (auto cc : connectedComp) {
 		// compute center of CC
 		for (auto n : cc) {
-			center += m_pos[n];
+			center += result->getNodeValue(n);
 		}
 		center /= cc.size();
 		// compute translation
@@ -315,225 +376,8 @@ bool CustomLayout::postProcessing() {
 		else translationY = m_gridY - modY;
 		center += tlp::Coord(translationX, translationY);
 		// apply translation
-		for (auto n : cc) {
-			m_pos[n] += tlp::Coord(translationX, translationY);
-		}
+		for (auto n : cc)
+			result->setNodeValue(n, result->getNodeValue(n) + tlp::Coord(translationX, translationY));
 	}
 	return true;
 }
-
-float CustomLayout::adaptativeCool(const tlp::node &n) {
-	tlp::Vec3f a = m_disp[n];
-	tlp::Vec3f b = m_dispPrev[n];
-	float a_norm = a.norm();
-	float b_norm = b.norm();
-	float angle = std::atan2(a.x() * b.y() - a.y() * b.x(), a.x() * b.x() + a.y() * b.y()); // atan2(det, dot)
-	float scalar;
-
-	// assign a scalar to b based on the angle between a and b
-	if (-fPI_6 <= angle && angle <= fPI_6)
-		scalar = 2;
-	else if ((fPI_6 < angle && angle <= f2_PI_6) || (-f2_PI_6 <= angle && angle < -fPI_6))
-		scalar = 3.0f / 2;
-	else if ((f2_PI_6 < angle && angle <= f3_PI_6) || (-f3_PI_6 <= angle && angle < -f2_PI_6))
-		scalar = 1;
-	else if ((f3_PI_6 < angle && angle <= f4_PI_6) || (-f4_PI_6 <= angle && angle < -f3_PI_6))
-		scalar = 2.0f / 3;
-	else
-		scalar = 1.0f / 3; 
-	
-	float res = scalar * b_norm;
-	return a_norm > res && res > 0 ? res : a_norm;
-}
-
-tlp::Coord CustomLayout::computeCenter(unsigned int start, unsigned int end) {
-	tlp::Coord center(0);
-	for (unsigned int i = start; i < end; ++i) {
-		center += m_pos[m_nodesCopy[i]];
-	}
-	return center / float(end - start);
-}
-
-float CustomLayout::computeRadius(unsigned int start, unsigned int end, tlp::Coord center) {
-	double maxRad = 0;
-	for (unsigned int i = start; i < end; ++i) {
-		const tlp::Coord &curCoord = m_pos[m_nodesCopy[i]];
-		tlp::Size curSize(m_size->getNodeValue(m_nodesCopy[i]) / 2.0f);
-		double nodeRad = sqrt(curSize.getW() * curSize.getW() + curSize.getH() * curSize.getH());
-		tlp::Coord radDir(curCoord - center);
-		double curRad = nodeRad + radDir.norm();
-		if (radDir.norm() < 1e-6) {
-			curRad = nodeRad;
-			radDir = tlp::Coord(1.0, 0.0, 0.0);
-		}
-		if (curRad > maxRad)
-			maxRad = curRad;
-	}
-	return maxRad;
-}
-
-void CustomLayout::buildKdTreeAux(KNode *node, unsigned int level, bool refresh) {
-	unsigned int medianIndex = (node->start + node->end) / 2;
-	auto medianIt = m_nodesCopy.begin() + medianIndex;
-	auto startIt = m_nodesCopy.begin() + node->start;
-	auto endIt = m_nodesCopy.begin() + node->end;
-
-	// find the median and rearrange m_nodesCopy around it
-	if (level % 2 == 0) {
-		std::nth_element(startIt, medianIt, endIt, [this](tlp::node &a, tlp::node &b) { 
-			return m_pos[a].x() < m_pos[b].x();
-		});
-		int medianX = m_pos[m_nodesCopy[medianIndex]].x();
-		std::partition(startIt, endIt, [this, &medianX](tlp::node &a) { 
-			return m_pos[a].x() < medianX;
-		});
-	} else { 
-		std::nth_element(startIt, medianIt, endIt, [this](tlp::node a, tlp::node b) {
-			return m_pos[a].y() < m_pos[b].y();
-		});
-		int medianY = m_pos[m_nodesCopy[medianIndex]].y();
-		std::partition(startIt, endIt, [this, &medianY](tlp::node &a) { 
-			return m_pos[a].y() < medianY;
-		});
-	}
-
-	// compute the new center and radius
-	tlp::Coord leftCenter = computeCenter(node->start, medianIndex);
-	tlp::Coord rightCenter = computeCenter(medianIndex, node->end);
-	float leftRadius = computeRadius(node->start, medianIndex, leftCenter);
-	float rightRadius = computeRadius(medianIndex, node->end, rightCenter);
-	if (refresh) {
-		node->leftChild->radius = leftRadius;
-		node->leftChild->center = leftCenter;
-		node->rightChild->radius = rightRadius;
-		node->rightChild->center = rightCenter;
-	} else {
-		node->leftChild = new KNode(node->start, medianIndex, leftRadius, leftCenter);
-		node->rightChild = new KNode(medianIndex, node->end, rightRadius, rightCenter);
-	}
-
-	// compute the multipolar expansion coefficients
-	if (m_multipoleExpansion) {
-		computeCoef(node->leftChild);
-		computeCoef(node->rightChild);
-	}
-
-	if (std::min(medianIndex - node->start, node->end - medianIndex) <= m_maxPartitionSize) return;
-	#pragma omp task
-	buildKdTreeAux(node->leftChild, level + 1, refresh);
-	#pragma omp task	
-	buildKdTreeAux(node->rightChild, level + 1, refresh);
-}
-
-KNode* CustomLayout::buildKdTree(bool refresh, KNode *root=nullptr) {
-	if (refresh && root == nullptr) {
-		pluginProgress->setError("Refresh is true but root node is null in CustomLayout::buildKdTree");
-		return root;
-	}
-	
-	// compute the center, radius and start the recursion 
-	tlp::Coord center = computeCenter(0, m_nodesCopy.size());
-	float radius = computeRadius(0, m_nodesCopy.size(), center);
-	if (refresh) {
-		root->radius = radius;
-		root->center = center;
-	} else {
-		root = new KNode(0, m_nodesCopy.size(), radius, center);
-	}
-
-	// compute the multipolar expansion coefficients
-	if (m_multipoleExpansion)
-		computeCoef(root);
-	
-	#pragma omp parallel
-	#pragma omp single
-	buildKdTreeAux(root, 0, refresh);
-	return root;
-}
-
-void CustomLayout::computeCoef(KNode *node) {
-	std::complex<float> ziMinusz0Overk;
-	std::vector<std::complex<float>> coefs;
-	unsigned int nbCoefs = m_pTerm;
-	coefs.reserve(nbCoefs);
-	for (unsigned int i = 0; i < nbCoefs; ++i)
-		coefs.push_back(std::complex<float>(0, 0));
-	node->a0 = node->end - node->start;
-	for (unsigned int i = node->start; i < node->end; ++i) {
-		tlp::node v = m_nodesCopy[i];
-		tlp::Coord dist = m_pos[v] - node->center;
-		ziMinusz0Overk = std::complex<float>(dist.x(), dist.y()); 
-		for (unsigned int k = 1; k < nbCoefs+1; ++k) {
-			coefs[k-1] += -1.0f * ziMinusz0Overk / (float)k; // ak
-			ziMinusz0Overk *= ziMinusz0Overk; // next power
-		}
-	}
-	node->coefs = coefs;
-}
-
-void CustomLayout::computeReplForces(const tlp::node &n, KNode *kdTree, bool computeEnergy) {
-	if (kdTree == nullptr) {
-		pluginProgress->setError("nullptr kdTree in CustomLayout::computeReplForces");
-		return;
-	}
-	tlp::Coord dist = m_pos[n] - kdTree->center;
-	float distNorm = dist.norm();
-
-	// leaf node -> compute the extact repulsive forces
-	if (kdTree->leftChild == nullptr && kdTree->rightChild == nullptr) {
-		for (unsigned int i = kdTree->start; i < kdTree->end; ++i) {
-			const tlp::node &v = m_nodesCopy[i];
-			if (n != v) {
-				tlp::Coord dist = m_pos[n] - m_pos[v];
-				dist *= computeReplForce(dist);
-				m_disp[n] += dist;
-				if (computeEnergy)
-					m_energy[n] += computeReplForceIntgr(dist);
-			}
-		}
-		return;
-	}
-
-	// internal node -> approximate the forces if outside of the bounds, else continue the recursion 
-	if (distNorm > kdTree->radius) {	
-		if (!m_multipoleExpansion) {
-			dist *= (kdTree->end - kdTree->start) * computeReplForce(dist);
-			m_disp[n] += dist;
-		} else {
-			std::complex<float> zMinusz0 = std::complex<float>(dist.x(), dist.y());
-			std::complex<float> potential = kdTree->a0 / zMinusz0; 
-			for (unsigned int k = 1; k < m_pTerm+1; ++k) {
-				zMinusz0 *= zMinusz0; // next power
-				potential += (float)k * kdTree->coefs[k-1] / zMinusz0;
-			}
-			m_disp[n] += tlp::Coord(potential.real(), -potential.imag()) * MULTIPOLE_EXPANSION_FACTOR;
-		}
-		if (computeEnergy) 
-			m_energy[n] += computeReplForceIntgr(dist);
-	}	else { 
-		computeReplForces(n, kdTree->leftChild, computeEnergy);
-		computeReplForces(n, kdTree->rightChild, computeEnergy);
-	}
-}
-
-void CustomLayout::computeRefinement(double totalEnergy) {
-	totalEnergy /= m_nodesCopy.size(); // now average energy
-	for (unsigned int i = 0; i < m_nodesCopy.size(); ++i) {
-		m_highEnergy->setNodeValue(m_nodesCopy[i], ((m_energy[m_nodesCopy[i]] - totalEnergy) / totalEnergy) > m_highEnergyThreshold);
-		m_energy[m_nodesCopy[i]] = 0;
-	}	
-	// save state, run the main loop, and then reload the state 
-	tlp::BooleanProperty *canMoveTemp = m_canMove;
-	bool refinementTemp = m_refinement;
-	bool stoppingCriterionTemp = m_stoppingCriterion;
-	bool conditionTemp = m_condition;
-	m_stoppingCriterion = false;
-	m_refinement = false;
-	m_canMove = m_highEnergy;
-	m_condition = true;
-	mainLoop(m_refinementIterations);
-	m_refinement = refinementTemp;
-	m_canMove = canMoveTemp;
-	m_stoppingCriterion = stoppingCriterionTemp;
-	m_condition = conditionTemp;
-}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #define _USE_MATH_DEFINES
 
 #include "incremental.h"
+#include "counter_rng.h"
 
 #include <tulip/ForEach.h>
 #include <tulip/BooleanProperty.h>
@@ -16,36 +17,54 @@
 #include <vector>
 #include <iterator>
 #include <math.h>
-#include <cstdlib>
-#include <ctime>
 
 const float TAU = 2.0f * M_PI;
 const float DEFAULT_IDEAL_EDGE_LENGTH = 20.0f;
+const unsigned int DEFAULT_SEED = 0;
+const unsigned int PACK_CC_FREQUENCY = 20; // Number of timeline steps between two packings of the connected components (if "pack CC" is true)
+const float MIN_STEP_BUDGET = 1e-6f; // Time budget of the steps once the budget of the timeline has run out, they keep the positions given by positionNodes
 const tlp::Color DEFAULT_NEW_COLOR = tlp::Color(18, 173, 42);
 const tlp::Color DEFAULT_ADJ_TO_DELETED_COLOR = tlp::Color(180, 10, 0);
 
 Incremental::Incremental(const tlp::PluginContext* context) 
-    : tlp::Algorithm(context), m_idealEdgeLength(DEFAULT_IDEAL_EDGE_LENGTH), m_newColor(DEFAULT_NEW_COLOR), m_adjToDeletedColor(DEFAULT_ADJ_TO_DELETED_COLOR) {
+    : tlp::Algorithm(context), m_seed(DEFAULT_SEED), m_idealEdgeLength(DEFAULT_IDEAL_EDGE_LENGTH), m_timeBudget(0), m_newColor(DEFAULT_NEW_COLOR), m_adjToDeletedColor(DEFAULT_ADJ_TO_DELETED_COLOR) {
     addInParameter<bool>("adaptive cooling", "If true, the algo uses a local cooling function based on the angle between each node's movement. Else it uses a global linear cooling function.", "", false);
 	addInParameter<bool>("stopping criterion", "If true, stops the algo before the maximum number of iterations if the graph has converged. See \"convergence threshold\"", "", false);
-	addInParameter<bool>("multipole expansion", "If true, apply a 4-term multipole expansion for more accurate layout. May affect performances.", "", false);
+	addInParameter<bool>("multipole expansion", "If true, apply a multipole expansion of \"p-term\" terms for more accurate layout. May affect performances.", "", false);
+	addInParameter<bool>("fast multipole method", "If true, the repulsive forces are computed cell to cell with the Fast Multipole Method (translation of the multipole expansions into local expansions), in linear time. Takes precedence over \"multipole expansion\".", "", false);
+	addInParameter<bool>("cutoff repulsion", "If true, a node is only repulsed by the nodes closer than about \"cutoff radius\". Suits the timeline steps, where the global shape is already set.", "", false);
+	addInParameter<bool>("interaction lists", "If true, the repulsive forces are computed leaf by leaf from interaction lists that are reused until the kd-tree is rebuilt (see \"interaction lists\" of Custom Layout).", "", false);
+	addInParameter<bool>("reorder nodes", "If true, the nodes are renumbered along a Hilbert curve each time the kd-tree is rebuilt (see \"reorder nodes\" of Custom Layout).", "", false);
+	addInParameter<bool>("active set", "If true, the nodes that stayed at rest for \"rest iterations\" iterations are frozen until a neighbour or a close node moves more than \"wake threshold\". Most nodes of a timeline step barely move.", "", false);
 	addInParameter<bool>("refinement", "", "", false);	
-    addInParameter<bool>("pack CC", "pack connected components", "", false);
+	addInParameter<bool>("double precision", "If true, each timeline step is computed in double precision instead of float.", "", false);
+	addInParameter<bool>("multilevel", "If true, each timeline step is laid out with the multilevel mode of Custom Layout: the graph is coarsened, and the layout of the coarsest graph is interpolated and refined level by level.", "", false);
+    addInParameter<bool>("pack CC", "If true, the connected components are laid out on their own and packed every 20 steps (see \"layout components\" of Custom Layout). The other steps lay out the whole graph, the components being attracted toward the center", "", false);
 	addInParameter<unsigned int>("max iterations", "The maximum number of iterations of the algorithm.", "300", false);
-	addInParameter<unsigned int>("max displacement", "The maximum length a node can move. Very high values or very low values may result in chaotic behavior.", "200", false);
+	addInParameter<float>("max displacement", "The maximum length a node can move. Very high values or very low values may result in chaotic behavior.", "200", false);
 	addInParameter<unsigned int>("refinement iterations", "", "20", false);
 	addInParameter<unsigned int>("refinement frequency", "", "30", false);	
+	addInParameter<unsigned int>("multilevel iterations", "The maximum number of iterations on each level of the multilevel hierarchy but the coarsest one. Only taken into account if \"multilevel\" is true", "50", false);
+	addInParameter<unsigned int>("rest iterations", "Number of consecutive iterations at rest after which a node is frozen. Only taken into account if \"active set\" is true", "10", false);
+	addInParameter<unsigned int>("p-term", "Number of terms of the multipole expansions (between 1 and 16). Only taken into account if \"multipole expansion\" or \"fast multipole method\" is true", "4", false);
+	addInParameter<unsigned int>("seed", "Seed of the random number generators. A given seed and number of threads always give the same timeline layout.", "0", false);
 	addInParameter<float>("ideal edge length", "The ideal edge length.", "10", false);
 	addInParameter<float>("spring force strength", "Factor of the spring force", "1", false);
 	addInParameter<float>("repulsive force strength", "Factor of the repulsive force", "100", false);
 	addInParameter<float>("convergence threshold", "If the average node energy is lower than this threshold, the graph is considered to have converged and the algorithm stops. Only taken into consideration if \"stopping criterion\" is true", "0.1", false);
     addInParameter<float>("high energy threshold", "Threshold above which a node is consired to have a high energy", "1.0", false);	
 	addInParameter<float>("center attraction strength", "Strength of the attraction of nodes toward the center", "0.000001f", false);	
+	addInParameter<float>("cutoff radius", "Size of the cells of the uniform grid used by \"cutoff repulsion\".", "30", false);
+	addInParameter<float>("rest threshold", "A node that moves less than this length is at rest. Only taken into account if \"active set\" is true", "0.1", false);
+	addInParameter<float>("wake threshold", "A frozen node is woken up when one of its neighbours or a node close to it moves more than this length. Only taken into account if \"active set\" is true", "1.0", false);
+	addInParameter<float>("theta", "Opening criterion of the kd-tree (between 0 excluded and 1). Lower values are more precise and slower.", "1.0", false);
+	addInParameter<float>("time budget", "Wall-clock budget of the whole timeline in seconds, 0 for none. Each step gets the remaining time divided by the number of steps left, see \"time budget\" of Custom Layout.", "0", false);
+	addInParameter<float>("tree rebuild threshold", "The kd-tree is refitted to the new positions at each iteration, and fully rebuilt when the sum of the radii of its leaves, relative to the radius of the root, has grown by more than this factor since the last rebuild.", "1.5", false);
+	addOutParameter<unsigned int>("iterations done", "Total number of iterations done by Custom Layout over the whole timeline.");
     addDependency("Custom Layout", "1.0");
 }
 
 bool Incremental::check(std::string &errorMessage) {
-    std::srand(std::time(NULL));
     return true;
 }
 
@@ -69,10 +88,17 @@ bool Incremental::run() {
     tlp::LayoutProperty *currentPos;
     tlp::ColorProperty *currentColors;
     std::string message;
+    unsigned int iterations = 0;
+    unsigned int stepIterations = 0;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() 
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_timeBudget));
     for (unsigned int i = 0; i < subgraphs.size(); ++i) {
-        message = "Computing timeline... " + i;
-        message += "/ " + subgraphs.size();
+        message = "Computing timeline... " + std::to_string(i) + "/" + std::to_string(subgraphs.size());
         pluginProgress->setComment(message);
+        if (m_timeBudget > 0) { // the remaining time is shared between the steps left, so that a fast step leaves more time to the next ones
+            double remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+            ds.set("time budget", std::max(float(remaining / (subgraphs.size() - i)), MIN_STEP_BUDGET));
+        }
         currentPos = subgraphs[i]->getLocalProperty<tlp::LayoutProperty>("viewLayout"); // overwriting global property "viewLayout", it is now empty however
         currentColors = subgraphs[i]->getLocalProperty<tlp::ColorProperty>("viewColor");     
         currentPos->copy(previousPos);
@@ -83,18 +109,31 @@ bool Incremental::run() {
             ds.set("block nodes", true);
             ds.set("movable nodes", subgraphs[i]->getLocalProperty<tlp::BooleanProperty>("canMove"));
         }
-        ds.set("pack connected components", m_packCC ? i % 20 == 0 : false); 
-        subgraphs[i]->applyPropertyAlgorithm("Custom Layout", currentPos, errorMessage, nullptr, &ds);
+        // the components are laid out on their own only when they are packed, the other steps keep the attraction toward the center so that they do not drift apart
+        bool pack = m_packCC && i % PACK_CC_FREQUENCY == 0;
+        ds.set("layout components", pack);
+        ds.set("pack connected components", pack);
+        bool laidOut = subgraphs[i]->applyPropertyAlgorithm("Custom Layout", currentPos, errorMessage, nullptr, &ds);
+        if (laidOut && ds.get("iterations done", stepIterations)) // ds keeps the count of the previous step if this one failed
+            iterations += stepIterations;
         previousPos = currentPos;
-        pluginProgress->progress(i, subgraphs.size());
+        tlp::ProgressState state = tlp::ProgressState(pluginProgress->progress(i + 1, subgraphs.size()));
+        if (state == tlp::TLP_CANCEL)
+            return false;
+        if (state == tlp::TLP_STOP) // the steps left are not laid out
+            break;
     }
+    if (dataSet != nullptr)
+        dataSet->set("iterations done", iterations);
     return true;
 }
 
 void Incremental::init() {
     m_packCC = false;
+    m_seed = DEFAULT_SEED;
 	bool btemp = false;
 	int itemp = 0;
+	unsigned int uitemp = 0;
 	float ftemp = 0.0f;
 	if (dataSet != nullptr) {
 		if (dataSet->get("max iterations", itemp))
@@ -103,6 +142,12 @@ void Incremental::init() {
 			ds.set("refinement iterations", itemp);
 		if (dataSet->get("refinement frequency", itemp))
 			ds.set("refinement frequency", itemp);
+		if (dataSet->get("multilevel iterations", uitemp))
+			ds.set("multilevel iterations", uitemp);
+		if (dataSet->get("rest iterations", uitemp))
+			ds.set("rest iterations", uitemp);
+		if (dataSet->get("p-term", uitemp))
+			ds.set("p-term", uitemp);
 		if (dataSet->get("max displacement", ftemp))
 			ds.set("max displacement", ftemp);
 		if (dataSet->get("ideal edge length", ftemp))
@@ -117,17 +162,46 @@ void Incremental::init() {
 			ds.set("high energy threshold", ftemp);
         if (dataSet->get("center attraction strength", ftemp))
 			ds.set("center attraction strength", ftemp);
+		if (dataSet->get("tree rebuild threshold", ftemp))
+			ds.set("tree rebuild threshold", ftemp);
+		if (dataSet->get("theta", ftemp))
+			ds.set("theta", ftemp);
+		if (dataSet->get("cutoff radius", ftemp))
+			ds.set("cutoff radius", ftemp);
+		if (dataSet->get("rest threshold", ftemp))
+			ds.set("rest threshold", ftemp);
+		if (dataSet->get("wake threshold", ftemp))
+			ds.set("wake threshold", ftemp);
 		if (dataSet->get("adaptive cooling", btemp))
 			ds.set("adaptive cooling", btemp);
 		if (dataSet->get("stopping criterion", btemp))
 			ds.set("stopping criterion", btemp);
 		if (dataSet->get("multipole expansion", btemp))
 			ds.set("multipole expansion", btemp);
+		if (dataSet->get("fast multipole method", btemp))
+			ds.set("fast multipole method", btemp);
+		if (dataSet->get("cutoff repulsion", btemp))
+			ds.set("cutoff repulsion", btemp);
+		if (dataSet->get("interaction lists", btemp))
+			ds.set("interaction lists", btemp);
+		if (dataSet->get("reorder nodes", btemp))
+			ds.set("reorder nodes", btemp);
 		if (dataSet->get("refinement", btemp))
 			ds.set("refinement", btemp);
+		if (dataSet->get("multilevel", btemp))
+			ds.set("multilevel", btemp);
+		if (dataSet->get("active set", btemp))
+			ds.set("active set", btemp);
+		if (dataSet->get("double precision", btemp))
+			ds.set("double precision", btemp);
         if (dataSet->get("pack CC", btemp))
             m_packCC = btemp;
+        if (dataSet->get("time budget", ftemp))
+            m_timeBudget = ftemp;
+        if (dataSet->get("seed", uitemp))
+            m_seed = uitemp;
 	}
+    ds.set("seed", m_seed);
 }
 
 bool Incremental::computeDifference(tlp::Graph *oldGraph, tlp::Graph *newGraph) {
@@ -209,6 +283,7 @@ bool Incremental::positionNodes(tlp::Graph *g, tlp::Graph *previous) {
     tlp::node n;
     tlp::node n2;
     tlp::BoundingBox bb = tlp::computeBoundingBox(previous, posPrev, sizePrev, rotPrev);
+    CounterRng rng(m_seed, g->getId()); // one stream per step of the timeline
     
     // mark already positioned nodes, and list the new nodes
     forEach(n, g->getNodes()) {
@@ -263,10 +338,10 @@ bool Incremental::positionNodes(tlp::Graph *g, tlp::Graph *previous) {
             }
             unsigned int nbPositionedNeighbors = positionedNeighbors.size();
             if (nbPositionedNeighbors == 0) {
-                float randomAngle = (float(std::rand()) / float(RAND_MAX)) * float(TAU); 
+                float randomAngle = rng.uniform() * float(TAU); 
                 pos->setNodeValue(n, bb.center() + tlp::Vec3f(std::cos(randomAngle), std::sin(randomAngle)));
             } else if (nbPositionedNeighbors == 1) {
-                float randomAngle = (float(std::rand()) / float(RAND_MAX)) * float(TAU);
+                float randomAngle = rng.uniform() * float(TAU);
                 pos->setNodeValue(n, pos->getNodeValue(positionedNeighbors[0]) + tlp::Vec3f(m_idealEdgeLength * std::cos(randomAngle), m_idealEdgeLength * std::sin(randomAngle)));
                 canMove->setNodeValue(positionedNeighbors[0], true);
             } else {
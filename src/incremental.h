@@ -2,6 +2,7 @@
 #define FMMM_INCREMENTAL_H
 
 #include <string>
+#include <chrono>
 #include <tulip/Graph.h>
 #include <tulip/TulipPluginHeaders.h>
 
@@ -21,7 +22,9 @@ public:
 
 private:
     bool m_packCC; // Whether or not to pack connected components
+    unsigned int m_seed; // Seed of the random streams used to position new nodes
     float m_idealEdgeLength; // Ideal edge length
+    float m_timeBudget; // Wall-clock budget of the whole timeline in seconds, shared between the steps. 0 for none
     tlp::DataSet ds;
     tlp::Color m_newColor; // Color of new nodes
     tlp::Color m_adjToDeletedColor; // Color of nodes who lost a neighbor
@@ -0,0 +1,1953 @@
+#define _USE_MATH_DEFINES
+
+#include "layout_engine.h"
+#include "parallel.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <thread>
+
+const unsigned int MAX_CELLS_PER_NODE = 4; // The cells of the uniform grid are enlarged so that there are at most this many cells per node
+const unsigned int TASK_GRAIN = 256; // Cells with less nodes are not split into new tasks during the parallel tree traversals and constructions
+const unsigned int PARALLEL_PARTITION_SIZE = 1 << 15; // kd-tree nodes with more nodes are partitioned by all the threads, the smaller subtrees are built by tasks
+const unsigned int SELECT_SAMPLES = 31; // Number of keys sampled to choose the pivots of the parallel selection
+const unsigned int MULTILEVEL_COARSEST_SIZE = 50; // The graph is not coarsened below this number of nodes
+const float MULTILEVEL_MIN_REDUCTION = 0.8f; // The coarsening stops when a level keeps more than this ratio of the nodes of the previous one
+const float MULTILEVEL_TEMP_FACTOR = 2.0f; // Initial temperature of the refined levels, relative to the ideal edge length
+const float MULTILEVEL_JITTER = 0.5f; // Distance between an interpolated node and its parent, relative to the ideal edge length
+const double MIN_TIME_BUDGET = 1e-6; // Time budget given to the components laid out once the budget of the whole graph has run out, they stop at once
+const unsigned int COMPONENT_TASK_SIZE = 2048; // Smaller components are laid out concurrently, one task each, the larger ones one after the other with all the threads
+
+const float fPI_6 = M_PI / 6.0f;
+const float f2_PI_6 = 2.0f * fPI_6;
+const float f3_PI_6 = 3.0f * fPI_6;
+const float f4_PI_6 = 4.0f * fPI_6;
+
+/**
+ * @brief Pascal's triangle, used by the translations of the multipole and local expansions
+ */
+template <typename Real>
+struct BinomialTable {
+	Real values[2 * MAX_PTERM + 1][2 * MAX_PTERM + 1];
+
+	BinomialTable() {
+		for (unsigned int n = 0; n <= 2 * MAX_PTERM; ++n) {
+			values[n][0] = 1;
+			for (unsigned int k = 1; k <= 2 * MAX_PTERM; ++k)
+				values[n][k] = n == 0 ? 0 : values[n - 1][k - 1] + values[n - 1][k];
+		}
+	}
+
+	Real operator()(unsigned int n, unsigned int k) const {
+		return values[n][k];
+	}
+};
+template <typename Real>
+const BinomialTable<Real> BINOMIAL;
+
+template <typename Real>
+BasicLayoutEngine<Real>::BasicLayoutEngine(const LayoutParams &params) 
+	: m_cstTemp(params.constantTemp), m_cstInitTemp(params.constantInitTemp), m_condition(params.blockNodes), m_multipoleExpansion(params.multipoleExpansion), 
+	  m_fmm(params.fmm), m_cutoff(params.cutoff), m_interactionLists(params.interactionLists), m_adaptiveCooling(params.adaptiveCooling), m_stoppingCriterion(params.stoppingCriterion), m_refinement(params.refinement), 
+	  m_activeSet(params.activeSet), m_multilevel(params.multilevel), m_profile(params.profile), 
+	  m_components(params.components), m_packComponents(params.packComponents), m_attract(false), m_params(params), m_L(params.idealEdgeLength), m_Kr(params.repulsiveStrength), 
+	  m_Ks(params.springStrength), m_initTemp(params.initTemp), m_initTempFactor(params.initTempFactor), m_coolingFactor(params.coolingFactor), m_temp(params.initTemp), 
+	  m_threshold(params.convergenceThreshold), m_maxDisp(params.maxDisp), m_dispCap(params.maxDisp), m_highEnergyThreshold(params.highEnergyThreshold), m_centerAttrFactor(params.centerAttrFactor), 
+	  m_rebuildThreshold(params.rebuildThreshold), m_cutoffRadius(params.cutoffRadius), m_restThreshold(params.restThreshold), m_wakeThreshold(params.wakeThreshold), m_theta(params.theta), 
+	  m_builtLeafRadius(0), m_nbStatic(0), m_dynamicRoot(0), m_refining(false), m_pinThreads(params.pinThreads), m_reorderNodes(params.reorderNodes), m_subtreeOrder(params.pinThreads), m_stopped(false), m_timeBudget(params.timeBudget), m_snapshotIterations(params.snapshotIterations), m_snapshotInterval(params.snapshotInterval), m_snapshotting(false), m_iterations(params.iterations), m_refinementIterations(params.refinementIterations), m_refinementFreq(params.refinementFreq), 
+	  m_restIterations(params.restIterations), m_multilevelIterations(params.multilevelIterations), m_maxPartitionSize(params.maxPartitionSize), m_pTerm(params.pTerm), 
+	  m_seed(params.seed), m_step(0), m_listsValid(false), m_cellCols(0), m_cellRows(0), m_leafKernel(simd::selectLeafKernel<Real>()) {
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::setGraph(unsigned int nbNodes, const Real *x, const Real *y, const Real *width, const Real *height, 
+	const unsigned int *adjOffsets, const unsigned int *adjNodes, const char *movable) {
+	// copy the state of the nodes and their radius (first touched by the threads that process them, see firstTouch), and compute their bounding box
+	m_x.clear();
+	m_y.clear();
+	m_nodeRadius.clear();
+	m_x.resize(nbNodes);
+	m_y.resize(nbNodes);
+	m_nodeRadius.resize(nbNodes);
+	#pragma omp parallel for schedule(static)
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		Real halfW = width[i] / 2.0f;
+		Real halfH = height[i] / 2.0f;
+		m_x[i] = x[i];
+		m_y[i] = y[i];
+		m_nodeRadius[i] = std::sqrt(halfW * halfW + halfH * halfH);
+	}
+	m_movable.assign(nbNodes, true);
+	if (movable != nullptr)
+		m_movable.assign(movable, movable + nbNodes);
+	Real minX = std::numeric_limits<Real>::max(), minY = minX;
+	Real maxX = std::numeric_limits<Real>::lowest(), maxY = maxX;
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		Real halfW = width[i] / 2.0f;
+		Real halfH = height[i] / 2.0f;
+		minX = std::min(minX, x[i] - halfW);
+		maxX = std::max(maxX, x[i] + halfW);
+		minY = std::min(minY, y[i] - halfH);
+		maxY = std::max(maxY, y[i] + halfH);
+	}
+	if (nbNodes == 0)
+		minX = maxX = minY = maxY = 0;
+	m_adjOffsets.assign(adjOffsets, adjOffsets + nbNodes + 1);
+	m_adjNodes.assign(adjNodes, adjNodes + adjOffsets[nbNodes]);
+	initState(minX, maxX, minY, maxY);
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::setSubgraph(const BasicLayoutEngine &parent, const unsigned int *nodes, unsigned int nbNodes, const std::vector<unsigned int> &localId) {
+	// the state of the nodes is first touched by the threads that process them, as in setGraph
+	m_x.clear();
+	m_y.clear();
+	m_nodeRadius.clear();
+	m_x.resize(nbNodes);
+	m_y.resize(nbNodes);
+	m_nodeRadius.resize(nbNodes);
+	m_movable.resize(nbNodes);
+	#pragma omp parallel for schedule(static)
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		unsigned int v = nodes[i];
+		m_x[i] = parent.m_x[v];
+		m_y[i] = parent.m_y[v];
+		m_nodeRadius[i] = parent.m_nodeRadius[v];
+		m_movable[i] = parent.m_movable[v];
+	}
+	m_adjOffsets.assign(1, 0);
+	m_adjNodes.clear();
+	Real minX = std::numeric_limits<Real>::max(), minY = minX;
+	Real maxX = std::numeric_limits<Real>::lowest(), maxY = maxX;
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		unsigned int v = nodes[i];
+		minX = std::min(minX, m_x[i] - m_nodeRadius[i]);
+		maxX = std::max(maxX, m_x[i] + m_nodeRadius[i]);
+		minY = std::min(minY, m_y[i] - m_nodeRadius[i]);
+		maxY = std::max(maxY, m_y[i] + m_nodeRadius[i]);
+		for (unsigned int k = parent.m_adjOffsets[v]; k < parent.m_adjOffsets[v + 1]; ++k)
+			m_adjNodes.push_back(localId[parent.m_adjNodes[k]]);
+		m_adjOffsets.push_back(m_adjNodes.size());
+	}
+	if (nbNodes == 0)
+		minX = maxX = minY = maxY = 0;
+	initState(minX, maxX, minY, maxY);
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::initState(Real minX, Real maxX, Real minY, Real maxY) {
+	// initialise the temperature, and the attraction toward the center if the graph is not connected
+	m_temp = m_cstInitTemp ? m_initTemp : std::max(std::min(maxX - minX, maxY - minY) * m_initTempFactor, 2 * m_L);
+	m_center = Vec2((minX + maxX) / 2.0f, (minY + maxY) / 2.0f);
+	labelComponents();
+	m_attract = m_nbComponents > 1 && !m_components;
+	m_highEnergy.clear();
+	m_nodeIds.clear();
+	m_step = 0;
+	initBuffers();
+}
+
+template <typename Real>
+unsigned int BasicLayoutEngine<Real>::run() {
+	m_profiler.reset(m_profile);
+	m_stopped = false;
+	if (m_pinThreads) { // the arrays were first touched by the unpinned threads
+		m_pinning.pin();
+		retouchNodeArrays();
+	}
+	if (m_timeBudget > 0) {
+		m_deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_timeBudget));
+		m_loopDeadline = m_deadline;
+	}
+	m_snapshotting = m_snapshotCallback && (m_snapshotIterations > 0 || m_snapshotInterval > 0);
+	if (m_snapshotting) {
+		m_snapshots.start(m_snapshotCallback);
+		m_lastSnapshot = std::chrono::steady_clock::now();
+	}
+	unsigned int it;
+	if (m_components && m_nbComponents > 1)
+		it = componentLoop();
+	else
+		it = m_multilevel ? multilevelLoop() : mainLoop(m_iterations);
+	m_snapshots.stop();
+	m_snapshotting = false;
+	m_pinning.unpin();
+	return it;
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::labelComponents() {
+	unsigned int nbNodes = m_x.size();
+	const unsigned int NONE = std::numeric_limits<unsigned int>::max();
+	m_component.assign(nbNodes, NONE);
+	m_nbComponents = 0;
+	std::vector<unsigned int> stack;
+	for (unsigned int root = 0; root < nbNodes; ++root) {
+		if (m_component[root] != NONE)
+			continue;
+		m_component[root] = m_nbComponents;
+		stack.push_back(root);
+		while (!stack.empty()) {
+			unsigned int u = stack.back();
+			stack.pop_back();
+			for (unsigned int k = m_adjOffsets[u]; k < m_adjOffsets[u + 1]; ++k) {
+				if (m_component[m_adjNodes[k]] == NONE) {
+					m_component[m_adjNodes[k]] = m_nbComponents;
+					stack.push_back(m_adjNodes[k]);
+				}
+			}
+		}
+		++m_nbComponents;
+	}
+}
+
+template <typename Real>
+unsigned int BasicLayoutEngine<Real>::componentLoop() {
+	unsigned int nbNodes = m_x.size();
+
+	// group the nodes by component (counting sort), the id of a node in the engine of its component is its rank in the component
+	std::vector<unsigned int> compStart(m_nbComponents + 1, 0);
+	for (unsigned int i = 0; i < nbNodes; ++i)
+		++compStart[m_component[i] + 1];
+	for (unsigned int c = 0; c < m_nbComponents; ++c)
+		compStart[c + 1] += compStart[c];
+	std::vector<unsigned int> compNodes(nbNodes);
+	std::vector<unsigned int> localId(nbNodes);
+	std::vector<unsigned int> fill(compStart.begin(), compStart.end() - 1);
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		unsigned int slot = fill[m_component[i]]++;
+		compNodes[slot] = i;
+		localId[i] = slot - compStart[m_component[i]];
+	}
+	std::vector<unsigned int> bySize(m_nbComponents);
+	std::iota(bySize.begin(), bySize.end(), 0);
+	std::stable_sort(bySize.begin(), bySize.end(), [&compStart](unsigned int a, unsigned int b) {
+		return compStart[a + 1] - compStart[a] > compStart[b + 1] - compStart[b];
+	});
+
+	// each component is laid out by its own engine, with the same options. The components are independent so the result does not depend on the scheduling
+	LayoutParams params = m_params;
+	params.components = false;
+	params.pinThreads = false; // the threads are already pinned
+	if (m_refinement)
+		m_highEnergy.assign(nbNodes, false);
+	// with a time budget, a component gets the share of the remaining time of its nodes among those left (times the number of threads for the concurrent ones).
+	// The stop callback may not be thread-safe, so only this thread calls it: between the iterations of the components it lays out, and while it waits 
+	// for the other threads. It sets cancel, which the engines of the other threads poll. Once stopped, the components not started keep their initial layout
+	std::vector<unsigned int> iterations(m_nbComponents, 0);
+	std::atomic<bool> cancel(m_stopped); // the stop callback asked to stop, or the time budget ran out
+	std::atomic<bool> stopped(false); // a component stopped early
+	std::atomic<unsigned int> handled(0); // small components laid out or skipped
+	unsigned int nbSmall = 0;
+	std::thread::id caller = std::this_thread::get_id();
+	auto poll = [&](unsigned int done, unsigned int total) {
+		if (std::this_thread::get_id() == caller && !cancel && checkStop(done, total))
+			cancel = true;
+	};
+	// while the small components are laid out, this thread also publishes the snapshots, every m_snapshotIterations components handled 
+	// and/or every m_snapshotInterval seconds. The positions are copied back and published in the same critical section
+	unsigned int lastSnapshot = 0;
+	auto pollSmall = [&]() {
+		poll(handled, nbSmall);
+		if (!m_snapshotting || std::this_thread::get_id() != caller)
+			return;
+		unsigned int done = handled;
+		if ((m_snapshotIterations > 0 && done >= lastSnapshot + m_snapshotIterations)
+			|| (m_snapshotInterval > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - m_lastSnapshot).count() >= m_snapshotInterval)) {
+			#pragma omp critical(componentPositions)
+			snapshot(true);
+			lastSnapshot = done;
+		}
+	};
+	auto layoutComponent = [&](unsigned int c, double share, bool large) {
+		BasicLayoutEngine engine(params);
+		engine.setSubgraph(*this, compNodes.data() + compStart[c], compStart[c + 1] - compStart[c], localId);
+		if (m_timeBudget > 0) {
+			double remaining = std::chrono::duration<double>(m_deadline - std::chrono::steady_clock::now()).count();
+			engine.m_timeBudget = std::max(remaining * share, MIN_TIME_BUDGET);
+		}
+		if (large) { // laid out by all the (pinned) threads, its iterations are the progress
+			engine.setStopCallback([&](unsigned int done, unsigned int total) {
+				poll(done, total);
+				return cancel.load();
+			});
+			engine.m_subtreeOrder = m_subtreeOrder;
+		} else { // the progress is the number of small components handled
+			engine.setStopCallback([&](unsigned int, unsigned int) {
+				pollSmall();
+				return cancel.load();
+			});
+		}
+		iterations[c] = engine.run();
+		#pragma omp critical(componentPositions)
+		for (unsigned int j = compStart[c]; j < compStart[c + 1]; ++j) {
+			unsigned int i = compNodes[j];
+			m_x[i] = engine.m_x[localId[i]];
+			m_y[i] = engine.m_y[localId[i]];
+			if (!engine.m_highEnergy.empty())
+				m_highEnergy[i] = engine.m_highEnergy[localId[i]];
+		}
+		#pragma omp critical
+		m_profiler.add(engine.m_profiler);
+		if (engine.m_stopped)
+			stopped = true;
+	};
+
+	// the large components one after the other, their own loops are parallel...
+	unsigned int k = 0;
+	unsigned int nodesLeft = nbNodes;
+	for (; k < m_nbComponents && compStart[bySize[k] + 1] - compStart[bySize[k]] >= COMPONENT_TASK_SIZE; ++k) {
+		unsigned int size = compStart[bySize[k] + 1] - compStart[bySize[k]];
+		if (!cancel)
+			layoutComponent(bySize[k], double(size) / nodesLeft, true);
+		if (m_snapshotting)
+			snapshot(true);
+		nodesLeft -= size;
+	}
+	// ... and the small ones concurrently, the largest first, their loops run on a single thread
+	unsigned int nbThreads = maxThreads();
+	nbSmall = m_nbComponents - k;
+	if (!cancel && nbSmall > 0) {
+		#pragma omp parallel
+		{
+			#pragma omp for schedule(dynamic, 1) nowait
+			for (unsigned int t = k; t < m_nbComponents; ++t) {
+				if (!cancel) {
+					unsigned int c = bySize[t];
+					unsigned int size = compStart[c + 1] - compStart[c];
+					unsigned int left;
+					#pragma omp critical
+					{
+						left = nodesLeft;
+						nodesLeft -= size;
+					}
+					layoutComponent(c, std::min(1.0, double(size) * nbThreads / left), false);
+				}
+				++handled;
+				pollSmall();
+			}
+			// this thread keeps polling until the other threads are done
+			if (std::this_thread::get_id() == caller) {
+				while (handled < nbSmall) {
+					pollSmall();
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			}
+		}
+	}
+	m_stopped = m_stopped || cancel || stopped;
+
+	if (m_packComponents)
+		packComponents(compStart, compNodes);
+	return *std::max_element(iterations.begin(), iterations.end());
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::packComponents(const std::vector<unsigned int> &compStart, const std::vector<unsigned int> &compNodes) {
+	// bounding box of each component, and of the fixed ones
+	std::vector<Vec2> compMin(m_nbComponents), compMax(m_nbComponents);
+	std::vector<char> fixed(m_nbComponents, false);
+	Vec2 fixedMin(std::numeric_limits<Real>::max(), std::numeric_limits<Real>::max());
+	Vec2 fixedMax(std::numeric_limits<Real>::lowest(), std::numeric_limits<Real>::lowest());
+	double area = 0;
+	Real maxWidth = 0;
+	for (unsigned int c = 0; c < m_nbComponents; ++c) {
+		Real minX = std::numeric_limits<Real>::max(), minY = minX;
+		Real maxX = std::numeric_limits<Real>::lowest(), maxY = maxX;
+		for (unsigned int j = compStart[c]; j < compStart[c + 1]; ++j) {
+			unsigned int i = compNodes[j];
+			minX = std::min(minX, m_x[i] - m_nodeRadius[i]);
+			maxX = std::max(maxX, m_x[i] + m_nodeRadius[i]);
+			minY = std::min(minY, m_y[i] - m_nodeRadius[i]);
+			maxY = std::max(maxY, m_y[i] + m_nodeRadius[i]);
+			fixed[c] = fixed[c] || (m_condition && !m_movable[i]);
+		}
+		compMin[c] = Vec2(minX, minY);
+		compMax[c] = Vec2(maxX, maxY);
+		if (fixed[c]) {
+			fixedMin = Vec2(std::min(fixedMin.x(), minX), std::min(fixedMin.y(), minY));
+			fixedMax = Vec2(std::max(fixedMax.x(), maxX), std::max(fixedMax.y(), maxY));
+		} else {
+			area += double(maxX - minX + m_L) * (maxY - minY + m_L);
+			maxWidth = std::max(maxWidth, maxX - minX);
+		}
+	}
+
+	// shelf packing of the free components, the highest first, in rows about as wide as the packing is high
+	std::vector<unsigned int> byHeight;
+	for (unsigned int c = 0; c < m_nbComponents; ++c) {
+		if (!fixed[c])
+			byHeight.push_back(c);
+	}
+	std::stable_sort(byHeight.begin(), byHeight.end(), [&compMin, &compMax](unsigned int a, unsigned int b) {
+		return compMax[a].y() - compMin[a].y() > compMax[b].y() - compMin[b].y();
+	});
+	Real rowWidth = std::max(Real(std::sqrt(area)), maxWidth);
+	std::vector<Vec2> translation(m_nbComponents);
+	Real x = 0, y = 0, rowHeight = 0, packingWidth = 0;
+	for (unsigned int c : byHeight) {
+		Real width = compMax[c].x() - compMin[c].x();
+		Real height = compMax[c].y() - compMin[c].y();
+		if (x > 0 && x + width > rowWidth) { // next row
+			y += rowHeight + m_L;
+			x = rowHeight = 0;
+		}
+		translation[c] = Vec2(x - compMin[c].x(), y - compMin[c].y());
+		x += width + m_L;
+		rowHeight = std::max(rowHeight, height);
+		packingWidth = std::max(packingWidth, x - m_L);
+	}
+	Real packingHeight = y + rowHeight;
+
+	// center the rows on the initial center, or place them under the fixed components
+	Vec2 origin = fixedMax.x() >= fixedMin.x() ? Vec2(fixedMin.x(), fixedMax.y() + m_L) 
+		: Vec2(m_center.x() - packingWidth / 2, m_center.y() - packingHeight / 2);
+	#pragma omp parallel for
+	for (unsigned int i = 0; i < m_x.size(); ++i) {
+		unsigned int c = m_component[i];
+		if (!fixed[c]) {
+			m_x[i] += translation[c].x() + origin.x();
+			m_y[i] += translation[c].y() + origin.y();
+		}
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::initBuffers() {
+	unsigned int nbNodes = m_x.size();
+	m_order.resize(nbNodes);
+	for (unsigned int i = 0; i < nbNodes; ++i)
+		m_order[i] = i;
+	// the per-node arrays are first touched by the threads that process the nodes, so that their pages are on the NUMA node of these threads
+	firstTouch(m_dx, nbNodes, Real(0));
+	firstTouch(m_dy, nbNodes, Real(0));
+	firstTouch(m_dxPrev, nbNodes, Real(0));
+	firstTouch(m_dyPrev, nbNodes, Real(0));
+	firstTouch(m_energy, nbNodes, Real(0));
+	firstTouch(m_leafX, nbNodes, Real(0));
+	firstTouch(m_leafY, nbNodes, Real(0));
+	firstTouch(m_active, nbNodes, char(false));
+	m_activeNodes.reserve(nbNodes);
+	m_refineNodes.reserve(nbNodes);
+	m_threadDisp.resize(maxThreads());
+	m_threadEnergy.resize(maxThreads());
+	firstTouch(m_restCount, nbNodes, 0u);
+	firstTouch(m_lastDisp, nbNodes, Real(0));
+	if (m_cutoff) {
+		m_nodeCell.resize(nbNodes);
+		m_cellNodes.resize(nbNodes);
+		m_cellX.resize(nbNodes);
+		m_cellY.resize(nbNodes);
+		return; // no kd-tree
+	}
+
+	// allocate the kd-trees once, their topology is set at the start of each main loop (see setupKdTrees)
+	m_tree.clear();
+	m_tree.reserve(4 * nbNodes / std::max(m_maxPartitionSize, 1u) + 2);
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::setupKdTrees() {
+	unsigned int nbNodes = m_x.size();
+	m_nbStatic = 0;
+	if (m_condition) {
+		// the blocked nodes first, then the movable ones
+		for (unsigned int i = 0; i < nbNodes; ++i) {
+			if (!m_movable[i])
+				m_order[m_nbStatic++] = i;
+		}
+		unsigned int next = m_nbStatic;
+		for (unsigned int i = 0; i < nbNodes; ++i) {
+			if (m_movable[i])
+				m_order[next++] = i;
+		}
+	}
+	m_tree.clear();
+	m_dynamicRoot = 0;
+	if (m_nbStatic > 0) {
+		buildKdTreeTopology(0, m_nbStatic, m_nbStatic > m_maxPartitionSize);
+		m_dynamicRoot = m_tree.size();
+		buildKdTree(0);
+		gatherLeafPositions(0, m_nbStatic);
+	}
+	if (m_nbStatic < nbNodes)
+		buildKdTreeTopology(m_nbStatic, nbNodes, nbNodes - m_nbStatic > m_maxPartitionSize);
+	m_builtLeafRadius = 0;
+	m_listsValid = false;
+	if (m_fmm) {
+		m_localCoefs.resize(m_tree.size() * MAX_PTERM);
+		m_localEnergy.resize(m_tree.size());
+	}
+}
+
+/*
+ * Specializations of the passes of an iteration on the options, indexed by the options: the options are tested once per iteration 
+ * instead of once per node (or per pair of nodes), and the compiler drops the dead branches of each loop
+ */
+template <typename Real>
+const typename BasicLayoutEngine<Real>::Pass BasicLayoutEngine<Real>::REPULSION_PASSES[NB_REPULSION_MODES][2][2][2] = {
+	{{{&BasicLayoutEngine::repulsionPass<TREE_REPULSION, false, false, false>, &BasicLayoutEngine::repulsionPass<TREE_REPULSION, false, false, true>},
+	  {&BasicLayoutEngine::repulsionPass<TREE_REPULSION, false, true, false>, &BasicLayoutEngine::repulsionPass<TREE_REPULSION, false, true, true>}},
+	 {{&BasicLayoutEngine::repulsionPass<TREE_REPULSION, true, false, false>, &BasicLayoutEngine::repulsionPass<TREE_REPULSION, true, false, true>},
+	  {&BasicLayoutEngine::repulsionPass<TREE_REPULSION, true, true, false>, &BasicLayoutEngine::repulsionPass<TREE_REPULSION, true, true, true>}}},
+	{{{&BasicLayoutEngine::listRepulsionPass<false, false, false>, &BasicLayoutEngine::listRepulsionPass<false, false, true>},
+	  {&BasicLayoutEngine::listRepulsionPass<false, true, false>, &BasicLayoutEngine::listRepulsionPass<false, true, true>}},
+	 {{&BasicLayoutEngine::listRepulsionPass<true, false, false>, &BasicLayoutEngine::listRepulsionPass<true, false, true>},
+	  {&BasicLayoutEngine::listRepulsionPass<true, true, false>, &BasicLayoutEngine::listRepulsionPass<true, true, true>}}},
+	{{{&BasicLayoutEngine::repulsionPass<FMM_REPULSION, false, false, false>, &BasicLayoutEngine::repulsionPass<FMM_REPULSION, false, false, true>},
+	  {&BasicLayoutEngine::repulsionPass<FMM_REPULSION, false, true, false>, &BasicLayoutEngine::repulsionPass<FMM_REPULSION, false, true, true>}},
+	 {{&BasicLayoutEngine::repulsionPass<FMM_REPULSION, true, false, false>, &BasicLayoutEngine::repulsionPass<FMM_REPULSION, true, false, true>},
+	  {&BasicLayoutEngine::repulsionPass<FMM_REPULSION, true, true, false>, &BasicLayoutEngine::repulsionPass<FMM_REPULSION, true, true, true>}}},
+	{{{&BasicLayoutEngine::repulsionPass<CUTOFF_REPULSION, false, false, false>, &BasicLayoutEngine::repulsionPass<CUTOFF_REPULSION, false, false, true>},
+	  {&BasicLayoutEngine::repulsionPass<CUTOFF_REPULSION, false, true, false>, &BasicLayoutEngine::repulsionPass<CUTOFF_REPULSION, false, true, true>}},
+	 {{&BasicLayoutEngine::repulsionPass<CUTOFF_REPULSION, true, false, false>, &BasicLayoutEngine::repulsionPass<CUTOFF_REPULSION, true, false, true>},
+	  {&BasicLayoutEngine::repulsionPass<CUTOFF_REPULSION, true, true, false>, &BasicLayoutEngine::repulsionPass<CUTOFF_REPULSION, true, true, true>}}}
+};
+
+template <typename Real>
+const typename BasicLayoutEngine<Real>::Pass BasicLayoutEngine<Real>::ATTRACTION_PASSES[2] = {
+	&BasicLayoutEngine::attractionPass<false>, &BasicLayoutEngine::attractionPass<true>
+};
+
+template <typename Real>
+const typename BasicLayoutEngine<Real>::Pass BasicLayoutEngine<Real>::UPDATE_PASSES[2][2] = {
+	{&BasicLayoutEngine::updatePass<false, false>, &BasicLayoutEngine::updatePass<false, true>},
+	{&BasicLayoutEngine::updatePass<true, false>, &BasicLayoutEngine::updatePass<true, true>}
+};
+
+template <typename Real>
+unsigned int BasicLayoutEngine<Real>::mainLoop(unsigned int maxIterations) {
+	bool quit = false;
+	bool refinement = false;
+	unsigned int it = 1;
+	unsigned int done = 0; // iterations whose displacements were applied to at least one node
+	double totalDisp = 0;
+	double totalEnergy = 0;
+	unsigned int nbNodes = m_x.size();
+	unsigned int nbThreads = m_threadDisp.size();
+
+	bool setupTrees = !m_cutoff && !m_refining; // a refinement pass reuses the trees of the main loop that started it
+	bool budget = m_timeBudget > 0 && !m_refining; // a refinement pass keeps the temperature of the main loop that started it
+	std::chrono::steady_clock::time_point loopStart = std::chrono::steady_clock::now();
+	Real finalTemp = (m_adaptiveCooling ? m_maxDisp : m_temp) * std::pow(m_coolingFactor, Real(maxIterations));
+	if (budget)
+		m_dispCap = m_maxDisp;
+	while (!quit && it <= maxIterations && !checkStop(it - 1, m_refining ? 0 : maxIterations)) {
+		double phase = m_profiler.begin();
+		if (m_cutoff) {
+			buildCellGrid();
+		} else {
+			// the static tree of the blocked nodes is built once, only the dynamic tree of the movable nodes follows them
+			if (setupTrees)
+				setupKdTrees();
+			setupTrees = false;
+			if (m_nbStatic < nbNodes) {
+				bool rebuilt = m_builtLeafRadius == 0;
+				if (rebuilt)
+					buildKdTree(m_dynamicRoot);
+				else
+					rebuilt = refitKdTree();
+				if (rebuilt && (m_reorderNodes || m_subtreeOrder) && !m_refining) // a refinement pass keeps the ids of its nodes
+					reorderNodes();
+				gatherLeafPositions(m_nbStatic, nbNodes);
+			}
+		}
+		m_profiler.end(Profiler::TREE, phase);
+		phase = m_profiler.begin();
+		scheduleActiveNodes();
+		unsigned int nbActive = m_activeNodes.size();
+		m_profiler.end(Profiler::SCHEDULE, phase);
+		if (checkStop(0, 0))
+			break;
+
+		refinement = !m_refining && m_condition && m_refinement && it > 0 && it % m_refinementFreq == 0; // no need to refine if there are no blocked nodes...
+
+		// compute repulsive forces
+		phase = m_profiler.begin();
+		if (m_fmm && !m_cutoff)
+			computeFmmForces(refinement);
+		(this->*REPULSION_PASSES[repulsionMode()][m_multipoleExpansion][m_attract][refinement])();
+		m_profiler.end(Profiler::REPULSION, phase);
+
+		// compute attractive forces
+		phase = m_profiler.begin();
+		(this->*ATTRACTION_PASSES[refinement])();
+		m_profiler.end(Profiler::ATTRACTION, phase);
+		if (checkStop(0, 0)) { // the forces of this iteration are dropped
+			std::fill(m_dx.begin(), m_dx.end(), 0);
+			std::fill(m_dy.begin(), m_dy.end(), 0);
+			break;
+		}
+
+		// update nodes position, the sums are reduced per thread and then in the threads order so that they do not depend on the scheduling
+		phase = m_profiler.begin();
+		(this->*UPDATE_PASSES[m_adaptiveCooling][refinement])();
+		if (nbActive > 0)
+			++done;
+		for (unsigned int t = 0; t < nbThreads; ++t) {
+			totalDisp += m_threadDisp[t];
+			totalEnergy += m_threadEnergy[t];
+		}
+
+		// detect convergence
+		if (m_stoppingCriterion && !m_refining && totalDisp <= m_threshold * nbNodes) // m_threshold is relative to the average disp, so we scale it
+			quit = true;
+		if (nbActive == 0) // every node is blocked or frozen
+			quit = true;
+		totalDisp = 0;
+		m_profiler.end(Profiler::UPDATE, phase);
+		m_profiler.endIteration(m_step);
+
+		if (refinement || (quit && m_refinement && !m_refining)) {
+			phase = m_profiler.begin();
+			computeRefinement(totalEnergy);
+			m_profiler.end(Profiler::REFINEMENT, phase);
+		}
+		totalEnergy = 0;
+
+		if (m_snapshotting)
+			snapshot(false);
+
+		if (budget)
+			fitCooling(loopStart, it, maxIterations, finalTemp);
+		else if (!m_adaptiveCooling && !m_cstTemp)
+			m_temp *= m_coolingFactor;
+
+		++it;
+		++m_step;
+	}
+	if (!m_refining && !m_nodeIds.empty())
+		restoreNodeOrder();
+	return done;
+}
+
+template <typename Real>
+bool BasicLayoutEngine<Real>::checkStop(unsigned int done, unsigned int total) {
+	if (!m_stopped && m_stopCallback && total > 0)
+		m_stopped = m_stopCallback(done, total);
+	if (!m_stopped && m_timeBudget > 0)
+		m_stopped = std::chrono::steady_clock::now() >= m_deadline;
+	return m_stopped;
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::snapshot(bool force) {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	bool publish = force || (m_snapshotIterations > 0 && (m_step + 1) % m_snapshotIterations == 0)
+		|| (m_snapshotInterval > 0 && std::chrono::duration<double>(now - m_lastSnapshot).count() >= m_snapshotInterval);
+	if (publish) {
+		m_snapshots.publish(m_x.data(), m_y.data(), m_x.size(), m_step, m_nodeIds.empty() ? nullptr : m_nodeIds.data());
+		m_lastSnapshot = now;
+	}
+}
+
+/**
+ * @brief Returns the index of the cell (x, y) along the Hilbert curve covering a 2^16 x 2^16 grid
+ */
+static uint32_t hilbertIndex(uint32_t x, uint32_t y) {
+	uint32_t index = 0;
+	for (uint32_t s = 1u << 15; s > 0; s >>= 1) {
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+		index += s * s * ((3 * rx) ^ ry);
+		// rotate the quadrant so that the curve enters and leaves it on the right sides
+		if (ry == 0) {
+			if (rx == 1) {
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return index;
+}
+
+/**
+ * @brief Gathers the elements of a per-node array in a new order, into an array first touched by the threads that process it
+ * @param perm The index of the element moved to k, for each k. Arrays of another size (not used by the current mode) are left as they are
+ */
+template <typename Vector>
+static void permuteArray(Vector &array, const std::vector<unsigned int> &perm) {
+	if (array.size() != perm.size())
+		return;
+	Vector permuted(perm.size());
+	#pragma omp parallel for schedule(static)
+	for (unsigned int k = 0; k < perm.size(); ++k)
+		permuted[k] = array[perm[k]];
+	array.swap(permuted);
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::reorderNodes() {
+	unsigned int nbNodes = m_x.size();
+	if (nbNodes < 2)
+		return;
+	if (m_subtreeOrder) { // the node at m_order[j] gets the id j, the trees being in pre-order each subtree is a range of ids
+		permuteNodes(std::vector<unsigned int>(m_order)); // a copy, permuteNodes renumbers m_order
+		return;
+	}
+	Real minX = m_x[0], maxX = m_x[0], minY = m_y[0], maxY = m_y[0];
+	for (unsigned int i = 1; i < nbNodes; ++i) {
+		minX = std::min(minX, m_x[i]);
+		maxX = std::max(maxX, m_x[i]);
+		minY = std::min(minY, m_y[i]);
+		maxY = std::max(maxY, m_y[i]);
+	}
+	Real scale = Real(65535) / std::max(std::max(maxX - minX, maxY - minY), std::numeric_limits<Real>::min());
+
+	// the ids are sorted by Hilbert index, then by id so that the order does not depend on the sort
+	std::vector<uint64_t> keys(nbNodes);
+	#pragma omp parallel for schedule(static)
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		uint32_t cellX = std::min(uint32_t((m_x[i] - minX) * scale), 65535u);
+		uint32_t cellY = std::min(uint32_t((m_y[i] - minY) * scale), 65535u);
+		keys[i] = (uint64_t(hilbertIndex(cellX, cellY)) << 32) | i;
+	}
+	std::sort(keys.begin(), keys.end());
+	std::vector<unsigned int> perm(nbNodes);
+	for (unsigned int k = 0; k < nbNodes; ++k)
+		perm[k] = unsigned(keys[k]);
+	permuteNodes(perm);
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::retouchNodeArrays() {
+	retouch(m_x);
+	retouch(m_y);
+	retouch(m_dx);
+	retouch(m_dy);
+	retouch(m_dxPrev);
+	retouch(m_dyPrev);
+	retouch(m_energy);
+	retouch(m_nodeRadius);
+	retouch(m_leafX);
+	retouch(m_leafY);
+	retouch(m_active);
+	retouch(m_restCount);
+	retouch(m_lastDisp);
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::restoreNodeOrder() {
+	std::vector<unsigned int> perm(m_nodeIds.size());
+	for (unsigned int k = 0; k < m_nodeIds.size(); ++k)
+		perm[m_nodeIds[k]] = k;
+	permuteNodes(perm);
+	m_nodeIds.clear();
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::permuteNodes(const std::vector<unsigned int> &perm) {
+	unsigned int nbNodes = perm.size();
+	std::vector<unsigned int> newId(nbNodes);
+	#pragma omp parallel for schedule(static)
+	for (unsigned int k = 0; k < nbNodes; ++k)
+		newId[perm[k]] = k;
+	if (m_nodeIds.empty()) {
+		m_nodeIds.resize(nbNodes);
+		std::iota(m_nodeIds.begin(), m_nodeIds.end(), 0);
+	}
+	permuteArray(m_nodeIds, perm);
+
+	// state of the nodes
+	permuteArray(m_x, perm);
+	permuteArray(m_y, perm);
+	permuteArray(m_dx, perm);
+	permuteArray(m_dy, perm);
+	permuteArray(m_dxPrev, perm);
+	permuteArray(m_dyPrev, perm);
+	permuteArray(m_energy, perm);
+	permuteArray(m_nodeRadius, perm);
+	permuteArray(m_movable, perm);
+	permuteArray(m_active, perm);
+	permuteArray(m_restCount, perm);
+	permuteArray(m_lastDisp, perm);
+	permuteArray(m_highEnergy, perm);
+	permuteArray(m_component, perm);
+
+	// CSR adjacency, the neighbours are renumbered
+	std::vector<unsigned int> adjOffsets(nbNodes + 1);
+	adjOffsets[0] = 0;
+	for (unsigned int k = 0; k < nbNodes; ++k)
+		adjOffsets[k + 1] = adjOffsets[k] + m_adjOffsets[perm[k] + 1] - m_adjOffsets[perm[k]];
+	std::vector<unsigned int> adjNodes(m_adjNodes.size());
+	#pragma omp parallel for schedule(static)
+	for (unsigned int k = 0; k < nbNodes; ++k) {
+		unsigned int next = adjOffsets[k];
+		for (unsigned int e = m_adjOffsets[perm[k]]; e < m_adjOffsets[perm[k] + 1]; ++e)
+			adjNodes[next++] = newId[m_adjNodes[e]];
+	}
+	m_adjOffsets.swap(adjOffsets);
+	m_adjNodes.swap(adjNodes);
+
+	// lists of ids, the kd-trees stay valid
+	for (std::vector<unsigned int> *ids : {&m_order, &m_activeNodes, &m_refineNodes}) {
+		#pragma omp parallel for schedule(static)
+		for (unsigned int j = 0; j < ids->size(); ++j)
+			(*ids)[j] = newId[(*ids)[j]];
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::fitCooling(std::chrono::steady_clock::time_point loopStart, unsigned int it, unsigned int maxIterations, Real finalTemp) {
+	if (m_cstTemp && !m_adaptiveCooling)
+		return;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double iterationTime = std::chrono::duration<double>(now - loopStart).count() / it;
+	double fitting = std::chrono::duration<double>(m_loopDeadline - now).count() / iterationTime;
+	Real &temp = m_adaptiveCooling ? m_dispCap : m_temp;
+	if (fitting < maxIterations - it)
+		temp *= std::pow(std::min(finalTemp / temp, Real(1)), Real(1 / std::max(fitting, 1.0)));
+	else if (!m_adaptiveCooling)
+		temp *= m_coolingFactor;
+}
+
+template <typename Real>
+template <typename BasicLayoutEngine<Real>::RepulsionMode MODE, bool MULTIPOLE, bool ATTRACT, bool ENERGY>
+void BasicLayoutEngine<Real>::repulsionPass() {
+	if (MODE == FMM_REPULSION && !ATTRACT) // the FMM forces are already computed
+		return;
+	#pragma omp parallel for
+	for (unsigned int a = 0; a < m_activeNodes.size(); ++a) {
+		unsigned int i = m_activeNodes[a];
+		if (MODE == CUTOFF_REPULSION) {
+			computeCellForces<ENERGY>(i);
+		} else if (MODE == TREE_REPULSION) {
+			CounterRng rng = nodeRng(i, 0);
+			if (m_dynamicRoot > 0)
+				computeReplForces<MULTIPOLE, ENERGY>(i, 0, rng);
+			computeReplForces<MULTIPOLE, ENERGY>(i, m_dynamicRoot, rng);
+		}
+		if (ATTRACT) {
+			Real distX = m_center.x() - m_x[i];
+			Real distY = m_center.y() - m_y[i];
+			Real sqNorm = distX * distX + distY * distY;
+			m_dx[i] += m_centerAttrFactor * distX / sqNorm;
+			m_dy[i] += m_centerAttrFactor * distY / sqNorm;
+		}
+	}
+}
+
+template <typename Real>
+template <bool MULTIPOLE, bool ATTRACT, bool ENERGY>
+void BasicLayoutEngine<Real>::listRepulsionPass() {
+	if (!m_listsValid)
+		buildInteractionLists();
+	#pragma omp parallel
+	{
+		// forces of the nodes of the current leaf, in the kd-tree order
+		std::vector<Real> fx, fy, energy;
+		#pragma omp for schedule(dynamic, 16)
+		for (unsigned int l = 0; l < m_listLeaves.size(); ++l) {
+			const KNode &leaf = m_tree[m_listLeaves[l]];
+			const InteractionList &list = m_lists[l];
+			unsigned int nbTargets = leaf.end - leaf.start;
+			bool active = false;
+			for (unsigned int j = leaf.start; j < leaf.end && !active; ++j)
+				active = m_active[m_order[j]];
+			if (!active)
+				continue;
+			fx.assign(nbTargets, 0);
+			fy.assign(nbTargets, 0);
+			if (ENERGY)
+				energy.assign(nbTargets, 0);
+			const Real *tx = m_leafX.data() + leaf.start;
+			const Real *ty = m_leafY.data() + leaf.start;
+
+			// near field: exact interactions of the whole leaf with each near leaf
+			for (unsigned int s : list.near) {
+				const KNode &source = m_tree[s];
+				m_profiler.count(Profiler::LEAF_PAIRS, nbTargets * (source.end - source.start));
+				m_leafKernel(tx, ty, nbTargets, m_leafX.data() + source.start, m_leafY.data() + source.start, source.end - source.start, m_Kr, 
+					fx.data(), fy.data(), ENERGY ? energy.data() : nullptr);
+			}
+
+			// far field: each far cell is approximated for all the nodes of the leaf
+			m_profiler.count(Profiler::FAR_FIELD, nbTargets * list.far.size());
+			for (unsigned int c : list.far) {
+				const KNode &cell = m_tree[c];
+				Real count = cell.end - cell.start;
+				for (unsigned int t = 0; t < nbTargets; ++t) {
+					Real distX = tx[t] - cell.center.x();
+					Real distY = ty[t] - cell.center.y();
+					Real sqNorm = distX * distX + distY * distY;
+					if (sqNorm == 0) // only if the node drifted onto the cell's center since the lists were built
+						continue;
+					if (!MULTIPOLE) {
+						Real force = count * m_Kr / sqNorm;
+						fx[t] += distX * force;
+						fy[t] += distY * force;
+					} else {
+						std::complex<Real> zMinusz0 = std::complex<Real>(distX, distY);
+						std::complex<Real> ratio = cell.scale() / zMinusz0;
+						std::complex<Real> ratioPowk = ratio;
+						std::complex<Real> sum = cell.a0; 
+						for (unsigned int k = 1; k < m_pTerm+1; ++k) {
+							sum -= (Real)k * cell.coefs[k-1] * ratioPowk;
+							ratioPowk *= ratio;
+						}
+						std::complex<Real> potential = sum / zMinusz0;
+						fx[t] += potential.real() * m_Kr;
+						fy[t] -= potential.imag() * m_Kr;
+					}
+					if (ENERGY)
+						energy[t] += computeReplForceIntgr(std::sqrt(sqNorm));
+				}
+			}
+
+			// scatter the forces to the active nodes of the leaf
+			for (unsigned int t = 0; t < nbTargets; ++t) {
+				unsigned int i = m_order[leaf.start + t];
+				if (!m_active[i])
+					continue;
+				m_dx[i] += fx[t];
+				m_dy[i] += fy[t];
+				if (ENERGY)
+					m_energy[i] += energy[t];
+				if (ATTRACT) {
+					Real distX = m_center.x() - m_x[i];
+					Real distY = m_center.y() - m_y[i];
+					Real sqNorm = distX * distX + distY * distY;
+					m_dx[i] += m_centerAttrFactor * distX / sqNorm;
+					m_dy[i] += m_centerAttrFactor * distY / sqNorm;
+				}
+			}
+		}
+	}
+}
+
+template <typename Real>
+template <bool ENERGY>
+void BasicLayoutEngine<Real>::attractionPass() {
+	// each node gathers the forces from its own neighbours
+	#pragma omp parallel for
+	for (unsigned int a = 0; a < m_activeNodes.size(); ++a) {
+		unsigned int i = m_activeNodes[a];
+		CounterRng rng = nodeRng(i, 1);
+		for (unsigned int k = m_adjOffsets[i]; k < m_adjOffsets[i + 1]; ++k) {
+			unsigned int v = m_adjNodes[k];
+			Real distX = m_x[i] - m_x[v];
+			Real distY = m_y[i] - m_y[v];
+			Real force = computeAttrForce(std::sqrt(distX * distX + distY * distY), rng);
+			distX *= force;
+			distY *= force;
+			m_dx[i] -= distX;
+			m_dy[i] -= distY;
+			if (ENERGY)
+				m_energy[i] += computeAttrForceIntgr(std::sqrt(distX * distX + distY * distY));
+		}
+	}
+}
+
+template <typename Real>
+template <bool ADAPTIVE, bool ENERGY>
+void BasicLayoutEngine<Real>::updatePass() {
+	std::fill(m_threadDisp.begin(), m_threadDisp.end(), 0);
+	std::fill(m_threadEnergy.begin(), m_threadEnergy.end(), 0);
+	#pragma omp parallel num_threads(m_threadDisp.size())
+	{
+		double localDisp = 0;
+		double localEnergy = 0;
+		unsigned int localMoved = 0;
+		#pragma omp for schedule(static) nowait
+		for (unsigned int a = 0; a < m_activeNodes.size(); a++) {
+			unsigned int i = m_activeNodes[a];
+			Real dispNorm = std::sqrt(m_dx[i] * m_dx[i] + m_dy[i] * m_dy[i]);
+			Real cooledNorm = dispNorm;
+			if (dispNorm != 0) {  
+				if (ADAPTIVE) {
+					cooledNorm = std::min(adaptativeCool(i), m_dispCap);
+					m_dx[i] *= cooledNorm / dispNorm;
+					m_dy[i] *= cooledNorm / dispNorm;
+				} else if (m_temp < dispNorm) {
+					cooledNorm = m_temp;
+					m_dx[i] *= cooledNorm / dispNorm;
+					m_dy[i] *= cooledNorm / dispNorm;
+				}				
+			}
+			if (ENERGY) localEnergy += m_energy[i];
+			localDisp += cooledNorm;
+			m_x[i] += m_dx[i];
+			m_y[i] += m_dy[i];
+			m_dxPrev[i] = m_dx[i];
+			m_dyPrev[i] = m_dy[i];
+			m_dx[i] = 0;
+			m_dy[i] = 0;
+			m_lastDisp[i] = cooledNorm;
+			m_restCount[i] = cooledNorm < m_restThreshold ? m_restCount[i] + 1 : 0;
+			localMoved += cooledNorm > 0;
+		}
+		m_profiler.count(Profiler::NODES_MOVED, localMoved);
+		m_threadDisp[threadId()] = localDisp;
+		m_threadEnergy[threadId()] = localEnergy;
+	}
+}
+
+template <typename Real>
+unsigned int BasicLayoutEngine<Real>::multilevelLoop() {
+	// coarsen the graph until it is small enough or the matching stops shrinking it, level 0 is the graph itself
+	std::vector<LayoutLevel> levels(1);
+	swapLevel(levels[0]);
+	while (levels.back().x.size() > MULTILEVEL_COARSEST_SIZE) {
+		LayoutLevel coarse;
+		coarsenLevel(levels.back(), coarse, levels.size());
+		if (coarse.x.size() > MULTILEVEL_MIN_REDUCTION * levels.back().x.size())
+			break;
+		levels.push_back(std::move(coarse));
+	}
+
+	// the time budget is shared between the levels in proportion to their number of nodes times their number of iterations
+	double work = 0;
+	for (unsigned int level = 0; level < levels.size(); ++level)
+		work += double(levels[level].x.size()) * (level + 1 == levels.size() ? m_iterations : m_multilevelIterations);
+
+	// lay out the coarsest level, then interpolate and refine the finer ones. Once stopped, the levels are still interpolated down to the graph itself
+	bool refinementTemp = m_refinement;
+	bool snapshottingTemp = m_snapshotting;
+	Real initTemp = m_temp;
+	unsigned int it = 0;
+	for (unsigned int level = levels.size(); level-- > 0;) {
+		bool coarsest = level + 1 == levels.size();
+		if (!coarsest)
+			prolongLevel(levels[level], levels[level + 1], level);
+		swapLevel(levels[level]);
+		initBuffers();
+		m_refinement = refinementTemp && level == 0; // the high energy nodes are those of the graph itself
+		m_snapshotting = snapshottingTemp && level == 0; // the positions of the coarse levels are not those of the nodes
+		m_temp = coarsest ? initTemp : MULTILEVEL_TEMP_FACTOR * m_L;
+		unsigned int iterations = coarsest ? m_iterations : m_multilevelIterations;
+		if (m_timeBudget > 0) {
+			double levelWork = double(m_x.size()) * iterations;
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			m_loopDeadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>((m_deadline - now) * (levelWork / work));
+			work -= levelWork;
+		}
+		it += mainLoop(iterations);
+		if (level > 0)
+			swapLevel(levels[level]);
+	}
+	m_refinement = refinementTemp;
+	m_snapshotting = snapshottingTemp;
+	return it;
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::coarsenLevel(LayoutLevel &fine, LayoutLevel &coarse, unsigned int level) {
+	const unsigned int NONE = std::numeric_limits<unsigned int>::max();
+	unsigned int nbNodes = fine.x.size();
+
+	// match each node with its unmatched neighbour of lowest degree, so that the hubs stay available for the leaves
+	std::vector<unsigned int> visitOrder(nbNodes);
+	for (unsigned int i = 0; i < nbNodes; ++i)
+		visitOrder[i] = i;
+	CounterRng rng(m_seed, level);
+	for (unsigned int i = nbNodes; i > 1; --i)
+		std::swap(visitOrder[i - 1], visitOrder[rng.next() % i]);
+	fine.parent.assign(nbNodes, NONE);
+	std::vector<unsigned int> members;
+	members.reserve(2 * nbNodes);
+	for (unsigned int u : visitOrder) {
+		if (fine.parent[u] != NONE)
+			continue;
+		unsigned int mate = NONE;
+		unsigned int mateDegree = NONE;
+		for (unsigned int k = fine.adjOffsets[u]; k < fine.adjOffsets[u + 1]; ++k) {
+			unsigned int v = fine.adjNodes[k];
+			unsigned int degree = fine.adjOffsets[v + 1] - fine.adjOffsets[v];
+			if (fine.parent[v] == NONE && v != u && degree < mateDegree) {
+				mate = v;
+				mateDegree = degree;
+			}
+		}
+		fine.parent[u] = members.size() / 2;
+		members.push_back(u);
+		if (mate != NONE)
+			fine.parent[mate] = fine.parent[u];
+		members.push_back(mate);
+	}
+
+	// the coarse nodes are at the barycenter of the nodes they merge, and can move if one of them can
+	unsigned int nbCoarse = members.size() / 2;
+	coarse.x.resize(nbCoarse);
+	coarse.y.resize(nbCoarse);
+	coarse.nodeRadius.resize(nbCoarse);
+	coarse.movable.resize(nbCoarse);
+	for (unsigned int c = 0; c < nbCoarse; ++c) {
+		unsigned int u = members[2 * c];
+		unsigned int v = members[2 * c + 1];
+		if (v == NONE)
+			v = u;
+		coarse.x[c] = (fine.x[u] + fine.x[v]) / 2.0f;
+		coarse.y[c] = (fine.y[u] + fine.y[v]) / 2.0f;
+		coarse.nodeRadius[c] = std::max(fine.nodeRadius[u], fine.nodeRadius[v]);
+		coarse.movable[c] = fine.movable[u] || fine.movable[v];
+	}
+
+	// the neighbours of a coarse node are the parents of the neighbours of its members, without loops nor duplicates
+	std::vector<unsigned int> lastSeen(nbCoarse, NONE);
+	coarse.adjOffsets.assign(nbCoarse + 1, 0);
+	coarse.adjNodes.clear();
+	for (unsigned int c = 0; c < nbCoarse; ++c) {
+		for (unsigned int m = 2 * c; m < 2 * c + 2 && members[m] != NONE; ++m) {
+			unsigned int u = members[m];
+			for (unsigned int k = fine.adjOffsets[u]; k < fine.adjOffsets[u + 1]; ++k) {
+				unsigned int neighbour = fine.parent[fine.adjNodes[k]];
+				if (neighbour != c && lastSeen[neighbour] != c) {
+					lastSeen[neighbour] = c;
+					coarse.adjNodes.push_back(neighbour);
+				}
+			}
+		}
+		coarse.adjOffsets[c + 1] = coarse.adjNodes.size();
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::prolongLevel(LayoutLevel &fine, const LayoutLevel &coarse, unsigned int level) {
+	CounterRng rng(m_seed, level);
+	for (unsigned int i = 0; i < fine.x.size(); ++i) {
+		if (m_condition && !fine.movable[i])
+			continue; // blocked nodes keep their position
+		Real angle = rng.uniform() * 2.0f * M_PI;
+		fine.x[i] = coarse.x[fine.parent[i]] + MULTILEVEL_JITTER * m_L * std::cos(angle);
+		fine.y[i] = coarse.y[fine.parent[i]] + MULTILEVEL_JITTER * m_L * std::sin(angle);
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::swapLevel(LayoutLevel &level) {
+	m_adjOffsets.swap(level.adjOffsets);
+	m_adjNodes.swap(level.adjNodes);
+	m_x.swap(level.x);
+	m_y.swap(level.y);
+	m_nodeRadius.swap(level.nodeRadius);
+	m_movable.swap(level.movable);
+}
+
+template <typename Real>
+Real BasicLayoutEngine<Real>::adaptativeCool(unsigned int i) {
+	Real a_norm = std::sqrt(m_dx[i] * m_dx[i] + m_dy[i] * m_dy[i]);
+	Real b_norm = std::sqrt(m_dxPrev[i] * m_dxPrev[i] + m_dyPrev[i] * m_dyPrev[i]);
+	Real angle = std::atan2(m_dx[i] * m_dyPrev[i] - m_dy[i] * m_dxPrev[i], m_dx[i] * m_dxPrev[i] + m_dy[i] * m_dyPrev[i]); // atan2(det, dot)
+	Real scalar;
+
+	// assign a scalar to b based on the angle between a and b
+	if (-fPI_6 <= angle && angle <= fPI_6)
+		scalar = 2;
+	else if ((fPI_6 < angle && angle <= f2_PI_6) || (-f2_PI_6 <= angle && angle < -fPI_6))
+		scalar = 3.0f / 2;
+	else if ((f2_PI_6 < angle && angle <= f3_PI_6) || (-f3_PI_6 <= angle && angle < -f2_PI_6))
+		scalar = 1;
+	else if ((f3_PI_6 < angle && angle <= f4_PI_6) || (-f4_PI_6 <= angle && angle < -f3_PI_6))
+		scalar = 2.0f / 3;
+	else
+		scalar = 1.0f / 3; 
+	
+	Real res = scalar * b_norm;
+	return a_norm > res && res > 0 ? res : a_norm;
+}
+
+template <typename Real>
+typename BasicLayoutEngine<Real>::Vec2 BasicLayoutEngine<Real>::computeCenter(unsigned int start, unsigned int end) {
+	Real centerX = 0;
+	Real centerY = 0;
+	for (unsigned int i = start; i < end; ++i) {
+		centerX += m_x[m_order[i]];
+		centerY += m_y[m_order[i]];
+	}
+	return Vec2(centerX, centerY) / Real(end - start);
+}
+
+template <typename Real>
+Real BasicLayoutEngine<Real>::computeRadius(unsigned int start, unsigned int end, Vec2 center) {
+	Real maxRad = 0;
+	for (unsigned int i = start; i < end; ++i) {
+		unsigned int v = m_order[i];
+		Real distX = m_x[v] - center.x();
+		Real distY = m_y[v] - center.y();
+		Real curRad = m_nodeRadius[v] + std::sqrt(distX * distX + distY * distY);
+		if (curRad > maxRad)
+			maxRad = curRad;
+	}
+	return maxRad;
+}
+
+template <typename Real>
+unsigned int BasicLayoutEngine<Real>::buildKdTreeTopology(unsigned int start, unsigned int end, bool split) {
+	unsigned int index = m_tree.size();
+	m_tree.push_back(KNode(start, end));
+	if (!split)
+		return index;
+	unsigned int medianIndex = (start + end) / 2;
+	bool splitChildren = std::min(medianIndex - start, end - medianIndex) > m_maxPartitionSize;
+	buildKdTreeTopology(start, medianIndex, splitChildren); // the left child is the next node in pre-order
+	unsigned int rightChild = buildKdTreeTopology(medianIndex, end, splitChildren);
+	m_tree[index].rightChild = rightChild;
+	return index;
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::buildKdTreeAux(unsigned int index, unsigned int level) {
+	KNode &node = m_tree[index];
+
+	// the radius of the node and the centers of its children in one pass, then the children
+	if (!node.isLeaf()) {
+		partitionKdNode(index, level, false);
+		splitKdNode(index, false);
+		bool spawn = node.end - node.start > TASK_GRAIN;
+		#pragma omp task if(spawn)
+		buildKdTreeAux(index + 1, level + 1);
+		#pragma omp task if(spawn)
+		buildKdTreeAux(node.rightChild, level + 1);
+		#pragma omp taskwait
+	} else {
+		splitKdNode(index, false);
+	}
+
+	// compute the multipolar expansion coefficients, from the vertices for the leaves and from the children upward
+	if (m_multipoleExpansion || m_fmm) {
+		if (node.isLeaf())
+			computeCoef(node);
+		else
+			shiftCoefs(index);
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::buildKdTreeTop(unsigned int index, unsigned int level, std::vector<std::pair<unsigned int, unsigned int>> &subtrees, std::vector<unsigned int> &topNodes) {
+	KNode &node = m_tree[index];
+	if (node.isLeaf() || node.end - node.start <= PARALLEL_PARTITION_SIZE) {
+		subtrees.push_back(std::make_pair(index, level));
+		return;
+	}
+	partitionKdNode(index, level, true);
+	splitKdNode(index, true);
+	topNodes.push_back(index);
+	buildKdTreeTop(index + 1, level + 1, subtrees, topNodes);
+	buildKdTreeTop(node.rightChild, level + 1, subtrees, topNodes);
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::partitionKdNode(unsigned int index, unsigned int level, bool parallel) {
+	const KNode &node = m_tree[index];
+	unsigned int medianIndex = m_tree[index + 1].end;
+	bool alongX = level % 2 == 0;
+	if (parallel) {
+		parallelSelect(node.start, medianIndex, node.end, alongX);
+	} else {
+		const Real *key = alongX ? m_x.data() : m_y.data();
+		std::nth_element(m_order.begin() + node.start, m_order.begin() + medianIndex, m_order.begin() + node.end, [key](unsigned int a, unsigned int b) {
+			return key[a] < key[b];
+		});
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::parallelSelect(unsigned int start, unsigned int median, unsigned int end, bool alongX) {
+	const Real *key = alongX ? m_x.data() : m_y.data();
+	unsigned int nbBlocks = maxThreads();
+	m_partitionBuffer.resize(m_order.size());
+	std::vector<unsigned int> counts(3 * nbBlocks);
+	unsigned int lo = start, hi = end;
+	while (hi - lo > PARALLEL_PARTITION_SIZE) {
+		// the pivot is the median of evenly spaced samples
+		Real samples[SELECT_SAMPLES];
+		for (unsigned int s = 0; s < SELECT_SAMPLES; ++s)
+			samples[s] = key[m_order[lo + (unsigned long)(hi - lo) * s / SELECT_SAMPLES]];
+		std::nth_element(samples, samples + SELECT_SAMPLES / 2, samples + SELECT_SAMPLES);
+		Real pivot = samples[SELECT_SAMPLES / 2];
+
+		// 3-way partition: each block counts its vertices lower than, equal to and greater than the pivot, then scatters them at its offsets
+		unsigned int n = hi - lo;
+		#pragma omp parallel
+		{
+			#pragma omp for schedule(static)
+			for (unsigned int b = 0; b < nbBlocks; ++b) {
+				unsigned int less = 0, equal = 0;
+				unsigned int blockEnd = lo + (unsigned long)n * (b + 1) / nbBlocks;
+				for (unsigned int j = lo + (unsigned long)n * b / nbBlocks; j < blockEnd; ++j) {
+					Real k = key[m_order[j]];
+					less += k < pivot;
+					equal += k == pivot;
+				}
+				counts[3 * b] = less;
+				counts[3 * b + 1] = equal;
+				counts[3 * b + 2] = blockEnd - (lo + (unsigned long)n * b / nbBlocks) - less - equal;
+			}
+			#pragma omp single
+			{
+				unsigned int offset[3] = {0, 0, 0};
+				for (unsigned int b = 0; b < nbBlocks; ++b) {
+					for (unsigned int c = 0; c < 3; ++c) {
+						unsigned int count = counts[3 * b + c];
+						counts[3 * b + c] = offset[c];
+						offset[c] += count;
+					}
+				}
+				for (unsigned int b = 0; b < nbBlocks; ++b) {
+					counts[3 * b + 1] += offset[0];
+					counts[3 * b + 2] += offset[0] + offset[1];
+				}
+			}
+			#pragma omp for schedule(static)
+			for (unsigned int b = 0; b < nbBlocks; ++b) {
+				unsigned int *target = m_partitionBuffer.data() + lo;
+				unsigned int blockEnd = lo + (unsigned long)n * (b + 1) / nbBlocks;
+				for (unsigned int j = lo + (unsigned long)n * b / nbBlocks; j < blockEnd; ++j) {
+					Real k = key[m_order[j]];
+					unsigned int c = k < pivot ? 0 : (k == pivot ? 1 : 2);
+					target[counts[3 * b + c]++] = m_order[j];
+				}
+			}
+			#pragma omp for schedule(static)
+			for (unsigned int j = lo; j < hi; ++j)
+				m_order[j] = m_partitionBuffer[j];
+		}
+
+		// continue in the part holding the median, or stop if it is equal to the pivot
+		unsigned int lessEnd = lo + counts[3 * (nbBlocks - 1)]; // the scatter offsets now point to the end of each block's parts
+		unsigned int greaterStart = lo + counts[3 * (nbBlocks - 1) + 1];
+		if (median < lessEnd)
+			hi = lessEnd;
+		else if (median >= greaterStart)
+			lo = greaterStart;
+		else
+			return;
+	}
+	std::nth_element(m_order.begin() + lo, m_order.begin() + median, m_order.begin() + hi, [key](unsigned int a, unsigned int b) {
+		return key[a] < key[b];
+	});
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::splitKdNode(unsigned int index, bool parallel) {
+	KNode &node = m_tree[index];
+	unsigned int medianIndex = node.isLeaf() ? node.end : m_tree[index + 1].end;
+	Vec2 center = node.center;
+
+	// maximal radius, and sums of the positions on both sides of the median
+	auto sweep = [this, center, medianIndex](unsigned int start, unsigned int end, Real partial[5]) {
+		Real maxRad = 0;
+		Real leftX = 0, leftY = 0, rightX = 0, rightY = 0;
+		for (unsigned int j = start; j < end; ++j) {
+			unsigned int v = m_order[j];
+			Real distX = m_x[v] - center.x();
+			Real distY = m_y[v] - center.y();
+			maxRad = std::max(maxRad, m_nodeRadius[v] + std::sqrt(distX * distX + distY * distY));
+			if (j < medianIndex) {
+				leftX += m_x[v];
+				leftY += m_y[v];
+			} else {
+				rightX += m_x[v];
+				rightY += m_y[v];
+			}
+		}
+		partial[0] = maxRad;
+		partial[1] = leftX;
+		partial[2] = leftY;
+		partial[3] = rightX;
+		partial[4] = rightY;
+	};
+	Real total[5] = {0, 0, 0, 0, 0};
+	if (parallel) {
+		unsigned int nbBlocks = maxThreads();
+		unsigned int n = node.end - node.start;
+		std::vector<Real> partials(5 * nbBlocks);
+		#pragma omp parallel for schedule(static)
+		for (unsigned int b = 0; b < nbBlocks; ++b)
+			sweep(node.start + (unsigned long)n * b / nbBlocks, node.start + (unsigned long)n * (b + 1) / nbBlocks, &partials[5 * b]);
+		for (unsigned int b = 0; b < nbBlocks; ++b) {
+			total[0] = std::max(total[0], partials[5 * b]);
+			for (unsigned int c = 1; c < 5; ++c)
+				total[c] += partials[5 * b + c];
+		}
+	} else {
+		sweep(node.start, node.end, total);
+	}
+	node.radius = total[0];
+	if (!node.isLeaf()) {
+		m_tree[index + 1].center = Vec2(total[1], total[2]) / Real(medianIndex - node.start);
+		m_tree[node.rightChild].center = Vec2(total[3], total[4]) / Real(node.end - medianIndex);
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::buildKdTree(unsigned int index) {
+	// the top levels are partitioned by all the threads, then their subtrees are built by tasks (with a sequential cutoff at TASK_GRAIN nodes)
+	KNode &root = m_tree[index];
+	root.center = computeCenter(root.start, root.end);
+	std::vector<std::pair<unsigned int, unsigned int>> subtrees;
+	std::vector<unsigned int> topNodes;
+	if (maxThreads() > 1)
+		buildKdTreeTop(index, 0, subtrees, topNodes);
+	else
+		subtrees.push_back(std::make_pair(index, 0u));
+	#pragma omp parallel
+	#pragma omp single
+	for (unsigned int s = 0; s < subtrees.size(); ++s) {
+		#pragma omp task firstprivate(s)
+		buildKdTreeAux(subtrees[s].first, subtrees[s].second);
+	}
+
+	// the multipole expansions of the top levels, children first
+	if (m_multipoleExpansion || m_fmm) {
+		for (unsigned int k = topNodes.size(); k-- > 0;)
+			shiftCoefs(topNodes[k]);
+	}
+	// if the nodes all lie on the same point, the ratio is undefined: 0 makes the main loop rebuild the tree at the next iteration
+	if (index == m_dynamicRoot)
+		m_builtLeafRadius = root.radius > std::numeric_limits<Real>::min() ? std::max(leafRadiusSum(index) / root.radius, std::numeric_limits<Real>::min()) : 0;
+	m_listsValid = false;
+}
+
+template <typename Real>
+bool BasicLayoutEngine<Real>::refitKdTree() {
+	Real leafRadius;
+	#pragma omp parallel
+	#pragma omp single
+	leafRadius = refitKdTreeAux(m_dynamicRoot);
+	Real rootRadius = m_tree[m_dynamicRoot].radius;
+	if (rootRadius <= std::numeric_limits<Real>::min() || leafRadius / rootRadius > m_rebuildThreshold * m_builtLeafRadius) {
+		buildKdTree(m_dynamicRoot);
+		return true;
+	}
+	return false;
+}
+
+template <typename Real>
+Real BasicLayoutEngine<Real>::refitKdTreeAux(unsigned int index) {
+	KNode &node = m_tree[index];
+	Real leafRadius;
+	if (node.isLeaf()) {
+		node.center = computeCenter(node.start, node.end);
+		node.radius = computeRadius(node.start, node.end, node.center);
+		leafRadius = node.radius;
+	} else {
+		Real leftLeafRadius, rightLeafRadius;
+		bool spawn = node.end - node.start > TASK_GRAIN;
+		#pragma omp task shared(leftLeafRadius) if(spawn)
+		leftLeafRadius = refitKdTreeAux(index + 1);
+		#pragma omp task shared(rightLeafRadius) if(spawn)
+		rightLeafRadius = refitKdTreeAux(node.rightChild);
+		#pragma omp taskwait
+		leafRadius = leftLeafRadius + rightLeafRadius;
+
+		// the center is the barycenter of the children's centers. The radius is recomputed from the nodes, 
+		// enclosing the children's circles would give much looser cells and slower traversals
+		const KNode &left = m_tree[index + 1];
+		const KNode &right = m_tree[node.rightChild];
+		Real leftWeight = Real(left.end - left.start) / Real(node.end - node.start);
+		node.center = left.center * leftWeight + right.center * (1.0f - leftWeight);
+		node.radius = computeRadius(node.start, node.end, node.center);
+	}
+	if (m_multipoleExpansion || m_fmm) {
+		if (node.isLeaf())
+			computeCoef(node);
+		else
+			shiftCoefs(index);
+	}
+	return leafRadius;
+}
+
+template <typename Real>
+Real BasicLayoutEngine<Real>::leafRadiusSum(unsigned int index) const {
+	// the subtree of a node is a contiguous range of the pre-order arena, the dynamic tree is stored after the static one
+	unsigned int last = index < m_dynamicRoot ? m_dynamicRoot : m_tree.size();
+	Real sum = 0;
+	for (unsigned int j = index; j < last; ++j) {
+		if (m_tree[j].isLeaf())
+			sum += m_tree[j].radius;
+	}
+	return sum;
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::computeCoef(KNode &node) {
+	unsigned int nbCoefs = m_pTerm;
+	Real scale = node.scale();
+	for (unsigned int i = 0; i < nbCoefs; ++i)
+		node.coefs[i] = std::complex<Real>(0, 0);
+	node.a0 = node.end - node.start;
+	for (unsigned int i = node.start; i < node.end; ++i) {
+		unsigned int v = m_order[i];
+		std::complex<Real> ziMinusz0((m_x[v] - node.center.x()) / scale, (m_y[v] - node.center.y()) / scale); 
+		std::complex<Real> ziMinusz0Powk = ziMinusz0;
+		for (unsigned int k = 1; k < nbCoefs+1; ++k) {
+			node.coefs[k-1] += -ziMinusz0Powk / (Real)k; // ak
+			ziMinusz0Powk *= ziMinusz0; // next power
+		}
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::shiftCoefs(unsigned int index) {
+	KNode &node = m_tree[index];
+	node.a0 = 0;
+	for (unsigned int l = 0; l < m_pTerm; ++l)
+		node.coefs[l] = std::complex<Real>(0, 0);
+	for (unsigned int child : {index + 1, node.rightChild}) {
+		const KNode &c = m_tree[child];
+		// with z0 the center of the child relative to the parent's: bl = -a0 z0^l / l + sum_{k=1..l} ak z0^(l-k) C(l-1, k-1), 
+		// everything being scaled by the parent's scale (d) and the child's one (ratio)
+		std::complex<Real> d((c.center.x() - node.center.x()) / node.scale(), (c.center.y() - node.center.y()) / node.scale());
+		Real ratio = c.scale() / node.scale();
+		std::complex<Real> dPow[MAX_PTERM + 1];
+		std::complex<Real> scaledCoefs[MAX_PTERM];
+		dPow[0] = 1;
+		Real ratioPowk = ratio;
+		for (unsigned int k = 1; k < m_pTerm+1; ++k) {
+			dPow[k] = dPow[k-1] * d;
+			scaledCoefs[k-1] = c.coefs[k-1] * ratioPowk;
+			ratioPowk *= ratio; // next power
+		}
+		for (unsigned int l = 1; l < m_pTerm+1; ++l) {
+			std::complex<Real> bl = -c.a0 * dPow[l] / (Real)l;
+			for (unsigned int k = 1; k <= l; ++k)
+				bl += BINOMIAL<Real>(l-1, k-1) * scaledCoefs[k-1] * dPow[l-k];
+			node.coefs[l-1] += bl;
+		}
+		node.a0 += c.a0;
+	}
+}
+
+template <typename Real>
+template <bool MULTIPOLE, bool ENERGY>
+void BasicLayoutEngine<Real>::computeReplForces(unsigned int i, unsigned int index, CounterRng &rng) {
+	const KNode &kdTree = m_tree[index];
+	m_profiler.count(Profiler::TREE_VISITS);
+	Real distX = m_x[i] - kdTree.center.x();
+	Real distY = m_y[i] - kdTree.center.y();
+	Real distNorm = std::sqrt(distX * distX + distY * distY);
+
+	// leaf node -> compute the extact repulsive forces
+	if (kdTree.isLeaf()) {
+		computeLeafForces<ENERGY>(i, kdTree);
+		return;
+	}
+
+	// internal node -> approximate the forces if outside of the bounds, else continue the recursion 
+	if (distNorm * m_theta > kdTree.radius) {	
+		m_profiler.count(Profiler::FAR_FIELD);
+		if (!MULTIPOLE) {
+			Real force = (kdTree.end - kdTree.start) * computeReplForce(distNorm, rng);
+			m_dx[i] += distX * force;
+			m_dy[i] += distY * force;
+		} else {
+			// derivative of the potential a0 log(z - z0) + sum(ak / (z - z0)^k), the force is its conjugate
+			std::complex<Real> zMinusz0 = std::complex<Real>(distX, distY);
+			std::complex<Real> ratio = kdTree.scale() / zMinusz0;
+			std::complex<Real> ratioPowk = ratio;
+			std::complex<Real> sum = kdTree.a0; 
+			for (unsigned int k = 1; k < m_pTerm+1; ++k) {
+				sum -= (Real)k * kdTree.coefs[k-1] * ratioPowk;
+				ratioPowk *= ratio; // next power
+			}
+			std::complex<Real> potential = sum / zMinusz0;
+			m_dx[i] += potential.real() * m_Kr;
+			m_dy[i] -= potential.imag() * m_Kr;
+		}
+		if (ENERGY) 
+			m_energy[i] += computeReplForceIntgr(distNorm);
+	}	else { 
+		computeReplForces<MULTIPOLE, ENERGY>(i, index + 1, rng);
+		computeReplForces<MULTIPOLE, ENERGY>(i, kdTree.rightChild, rng);
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::buildInteractionLists() {
+	m_listLeaves.clear();
+	for (unsigned int index = m_dynamicRoot; index < m_tree.size(); ++index) {
+		if (m_tree[index].isLeaf())
+			m_listLeaves.push_back(index);
+	}
+	if (m_lists.size() < m_listLeaves.size())
+		m_lists.resize(m_listLeaves.size());
+	#pragma omp parallel for schedule(dynamic, 16)
+	for (unsigned int l = 0; l < m_listLeaves.size(); ++l) {
+		InteractionList &list = m_lists[l];
+		list.near.clear();
+		list.far.clear();
+		const KNode &leaf = m_tree[m_listLeaves[l]];
+		if (m_dynamicRoot > 0)
+			listInteractions(leaf, 0, list);
+		listInteractions(leaf, m_dynamicRoot, list);
+	}
+	m_listsValid = true;
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::listInteractions(const KNode &target, unsigned int index, InteractionList &list) {
+	const KNode &cell = m_tree[index];
+	m_profiler.count(Profiler::TREE_VISITS);
+	Real distX = target.center.x() - cell.center.x();
+	Real distY = target.center.y() - cell.center.y();
+	Real distNorm = std::sqrt(distX * distX + distY * distY);
+	if ((distNorm - target.radius) * m_theta > cell.radius) {
+		list.far.push_back(index);
+	} else if (cell.isLeaf()) {
+		list.near.push_back(index);
+	} else {
+		listInteractions(target, index + 1, list);
+		listInteractions(target, cell.rightChild, list);
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::gatherLeafPositions(unsigned int start, unsigned int end) {
+	#pragma omp parallel for
+	for (unsigned int j = start; j < end; ++j) {
+		m_leafX[j] = m_x[m_order[j]];
+		m_leafY[j] = m_y[m_order[j]];
+	}
+}
+
+template <typename Real>
+template <bool ENERGY>
+void BasicLayoutEngine<Real>::computeLeafForces(unsigned int i, const KNode &leaf) {
+	m_profiler.count(Profiler::LEAF_PAIRS, leaf.end - leaf.start);
+	m_leafKernel(&m_x[i], &m_y[i], 1, m_leafX.data() + leaf.start, m_leafY.data() + leaf.start, leaf.end - leaf.start, m_Kr, 
+		&m_dx[i], &m_dy[i], ENERGY ? &m_energy[i] : nullptr);
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::scheduleActiveNodes() {
+	if (m_refining) // computeRefinement already listed the nodes of the pass
+		return;
+	unsigned int nbNodes = m_x.size();
+	if (m_activeSet) {
+		// a frozen node wakes up if one of its neighbours moved...
+		#pragma omp parallel for
+		for (unsigned int i = 0; i < nbNodes; ++i) {
+			if (m_restCount[i] < m_restIterations)
+				continue;
+			for (unsigned int k = m_adjOffsets[i]; k < m_adjOffsets[i + 1]; ++k) {
+				if (m_lastDisp[m_adjNodes[k]] > m_wakeThreshold) {
+					m_restCount[i] = 0;
+					break;
+				}
+			}
+		}
+		// ... or if a node of its leaf (or cell) moved, the leaves and cells are disjoint ranges of m_order (or m_cellNodes)
+		const std::vector<unsigned int> &order = m_cutoff ? m_cellNodes : m_order;
+		unsigned int nbRanges = m_cutoff ? m_cellCols * m_cellRows : m_tree.size();
+		#pragma omp parallel for
+		for (unsigned int r = 0; r < nbRanges; ++r) {
+			if (!m_cutoff && !m_tree[r].isLeaf())
+				continue;
+			unsigned int start = m_cutoff ? m_cellStart[r] : m_tree[r].start;
+			unsigned int end = m_cutoff ? m_cellStart[r + 1] : m_tree[r].end;
+			bool moved = false;
+			for (unsigned int j = start; j < end && !moved; ++j)
+				moved = m_lastDisp[order[j]] > m_wakeThreshold;
+			if (moved) {
+				for (unsigned int j = start; j < end; ++j)
+					m_restCount[order[j]] = 0;
+			}
+		}
+	}
+
+	m_activeNodes.clear();
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		m_active[i] = (!m_condition || m_movable[i]) && (!m_activeSet || m_restCount[i] < m_restIterations);
+		if (m_active[i])
+			m_activeNodes.push_back(i);
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::buildCellGrid() {
+	unsigned int nbNodes = m_x.size();
+	Real minX = std::numeric_limits<Real>::max(), minY = minX;
+	Real maxX = std::numeric_limits<Real>::lowest(), maxY = maxX;
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		minX = std::min(minX, m_x[i]);
+		maxX = std::max(maxX, m_x[i]);
+		minY = std::min(minY, m_y[i]);
+		maxY = std::max(maxY, m_y[i]);
+	}
+
+	// enlarge the cells if the graph is too spread out for the number of nodes
+	Real cellSize = std::max(m_cutoffRadius, std::numeric_limits<Real>::min());
+	double maxCells = (double)MAX_CELLS_PER_NODE * std::max(nbNodes, 1u);
+	while (((double)(maxX - minX) / cellSize + 1) * ((double)(maxY - minY) / cellSize + 1) > maxCells)
+		cellSize *= 2.0f;
+	m_cellCols = (unsigned int)((maxX - minX) / cellSize) + 1;
+	m_cellRows = (unsigned int)((maxY - minY) / cellSize) + 1;
+
+	// counting sort of the nodes by cell
+	m_cellStart.assign(m_cellCols * m_cellRows + 1, 0);
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		unsigned int col = std::min((unsigned int)((m_x[i] - minX) / cellSize), m_cellCols - 1);
+		unsigned int row = std::min((unsigned int)((m_y[i] - minY) / cellSize), m_cellRows - 1);
+		m_nodeCell[i] = row * m_cellCols + col;
+		++m_cellStart[m_nodeCell[i] + 1];
+	}
+	for (unsigned int c = 0; c < m_cellCols * m_cellRows; ++c)
+		m_cellStart[c + 1] += m_cellStart[c];
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		unsigned int slot = m_cellStart[m_nodeCell[i]]++;
+		m_cellX[slot] = m_x[i];
+		m_cellY[slot] = m_y[i];
+		m_cellNodes[slot] = i;
+	}
+	// the scatter moved each start to the end of its cell, i.e. the start of the next one
+	for (unsigned int c = m_cellCols * m_cellRows; c > 0; --c)
+		m_cellStart[c] = m_cellStart[c - 1];
+	m_cellStart[0] = 0;
+}
+
+template <typename Real>
+template <bool ENERGY>
+void BasicLayoutEngine<Real>::computeCellForces(unsigned int i) {
+	unsigned int row = m_nodeCell[i] / m_cellCols;
+	unsigned int col = m_nodeCell[i] % m_cellCols;
+	unsigned int firstCol = col > 0 ? col - 1 : 0;
+	unsigned int lastCol = std::min(col + 1, m_cellCols - 1);
+	// the cells of a row are contiguous, so each of the 3 rows is a single block of sources
+	for (unsigned int r = row > 0 ? row - 1 : 0; r <= std::min(row + 1, m_cellRows - 1); ++r) {
+		unsigned int start = m_cellStart[r * m_cellCols + firstCol];
+		unsigned int end = m_cellStart[r * m_cellCols + lastCol + 1];
+		m_profiler.count(Profiler::LEAF_PAIRS, end - start);
+		m_leafKernel(&m_x[i], &m_y[i], 1, m_cellX.data() + start, m_cellY.data() + start, end - start, m_Kr, 
+			&m_dx[i], &m_dy[i], ENERGY ? &m_energy[i] : nullptr);
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::computeFmmForces(bool computeEnergy) {
+	std::fill(m_localCoefs.begin() + m_dynamicRoot * MAX_PTERM, m_localCoefs.end(), std::complex<Real>(0, 0));
+	std::fill(m_localEnergy.begin() + m_dynamicRoot, m_localEnergy.end(), 0);
+	if (m_nbStatic == m_x.size()) // no movable node
+		return;
+	#pragma omp parallel
+	#pragma omp single
+	{
+		// only the movable nodes receive forces, from both trees
+		fmmInteract(m_dynamicRoot, m_dynamicRoot, computeEnergy);
+		if (m_dynamicRoot > 0)
+			fmmInteract(m_dynamicRoot, 0, computeEnergy);
+		fmmDownward(m_dynamicRoot, computeEnergy);
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::fmmInteract(unsigned int target, unsigned int source, bool computeEnergy) {
+	const KNode &t = m_tree[target];
+	const KNode &s = m_tree[source];
+	m_profiler.count(Profiler::TREE_VISITS);
+	Real z0X = s.center.x() - t.center.x();
+	Real z0Y = s.center.y() - t.center.y();
+	Real distNorm = std::sqrt(z0X * z0X + z0Y * z0Y);
+
+	// well-separated cells -> translate the multipole expansion of source into a local expansion around target's center (M2L)
+	if (distNorm * m_theta > t.radius + s.radius) {
+		m_profiler.count(Profiler::FAR_FIELD);
+		std::complex<Real> z0(z0X, z0Y);
+		std::complex<Real> minusU = -s.scale() / z0;
+		std::complex<Real> w = t.scale() / z0;
+		std::complex<Real> terms[MAX_PTERM];
+		std::complex<Real> minusUPowk = minusU;
+		for (unsigned int k = 1; k < m_pTerm+1; ++k) {
+			terms[k-1] = s.coefs[k-1] * minusUPowk;
+			minusUPowk *= minusU; // next power
+		}
+		std::complex<Real> *local = &m_localCoefs[target * MAX_PTERM];
+		std::complex<Real> wPowl = w;
+		for (unsigned int l = 1; l < m_pTerm+1; ++l) {
+			std::complex<Real> bl = -s.a0 / (Real)l;
+			for (unsigned int k = 1; k < m_pTerm+1; ++k)
+				bl += BINOMIAL<Real>(l+k-1, k-1) * terms[k-1];
+			local[l-1] += bl * wPowl;
+			wPowl *= w; // next power
+		}
+		if (computeEnergy)
+			m_localEnergy[target] += computeReplForceIntgr(distNorm);
+		return;
+	}
+
+	// two leaves -> compute the exact forces of the whole block of target's nodes
+	if (t.isLeaf() && s.isLeaf()) {
+		thread_local std::vector<Real> blockDx, blockDy, blockEnergy;
+		unsigned int nbTargets = t.end - t.start;
+		m_profiler.count(Profiler::LEAF_PAIRS, (uint64_t)nbTargets * (s.end - s.start));
+		blockDx.assign(nbTargets, 0);
+		blockDy.assign(nbTargets, 0);
+		blockEnergy.assign(nbTargets, 0);
+		m_leafKernel(m_leafX.data() + t.start, m_leafY.data() + t.start, nbTargets, m_leafX.data() + s.start, m_leafY.data() + s.start, s.end - s.start, 
+			m_Kr, blockDx.data(), blockDy.data(), computeEnergy ? blockEnergy.data() : nullptr);
+		for (unsigned int j = 0; j < nbTargets; ++j) {
+			unsigned int i = m_order[t.start + j];
+			if (m_active[i]) {
+				m_dx[i] += blockDx[j];
+				m_dy[i] += blockDy[j];
+				m_energy[i] += blockEnergy[j];
+			}
+		}
+		return;
+	}
+
+	// else split the biggest cell, the children of target are processed in parallel as they write to disjoint subtrees
+	if (s.isLeaf() || (!t.isLeaf() && t.radius >= s.radius)) {
+		bool spawn = t.end - t.start > TASK_GRAIN;
+		#pragma omp task if(spawn)
+		fmmInteract(target + 1, source, computeEnergy);
+		#pragma omp task if(spawn)
+		fmmInteract(t.rightChild, source, computeEnergy);
+		#pragma omp taskwait
+	} else {
+		fmmInteract(target, source + 1, computeEnergy);
+		fmmInteract(target, s.rightChild, computeEnergy);
+	}
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::fmmDownward(unsigned int index, bool computeEnergy) {
+	const KNode &node = m_tree[index];
+	const std::complex<Real> *local = &m_localCoefs[index * MAX_PTERM];
+
+	// leaf -> evaluate the derivative of the local expansion at the nodes (L2P), the force is its conjugate
+	if (node.isLeaf()) {
+		Real scale = node.scale();
+		for (unsigned int j = node.start; j < node.end; ++j) {
+			unsigned int i = m_order[j];
+			if (!m_active[i])
+				continue;
+			std::complex<Real> zeta((m_x[i] - node.center.x()) / scale, (m_y[i] - node.center.y()) / scale);
+			std::complex<Real> potential = (Real)m_pTerm * local[m_pTerm-1];
+			for (unsigned int l = m_pTerm - 1; l > 0; --l)
+				potential = potential * zeta + (Real)l * local[l-1];
+			potential /= scale;
+			m_dx[i] += potential.real() * m_Kr;
+			m_dy[i] -= potential.imag() * m_Kr;
+			if (computeEnergy)
+				m_energy[i] += m_localEnergy[index];
+		}
+		return;
+	}
+
+	// internal node -> shift the local expansion to the children's centers (L2L)
+	for (unsigned int child : {index + 1, node.rightChild}) {
+		const KNode &c = m_tree[child];
+		std::complex<Real> *childLocal = &m_localCoefs[child * MAX_PTERM];
+		std::complex<Real> d((c.center.x() - node.center.x()) / node.scale(), (c.center.y() - node.center.y()) / node.scale());
+		Real ratio = c.scale() / node.scale();
+		Real ratioPowl = ratio;
+		for (unsigned int l = 1; l < m_pTerm+1; ++l) {
+			std::complex<Real> bl(0, 0);
+			for (unsigned int k = m_pTerm; k >= l; --k) // Horner's scheme on d
+				bl = bl * d + BINOMIAL<Real>(k, l) * local[k-1];
+			childLocal[l-1] += bl * ratioPowl;
+			ratioPowl *= ratio; // next power
+		}
+		if (computeEnergy)
+			m_localEnergy[child] += m_localEnergy[index];
+	}
+	bool spawn = node.end - node.start > TASK_GRAIN;
+	#pragma omp task if(spawn)
+	fmmDownward(index + 1, computeEnergy);
+	#pragma omp task if(spawn)
+	fmmDownward(node.rightChild, computeEnergy);
+	#pragma omp taskwait
+}
+
+template <typename Real>
+void BasicLayoutEngine<Real>::computeRefinement(double totalEnergy) {
+	unsigned int nbNodes = m_x.size();
+	double averageEnergy = totalEnergy / nbNodes;
+	m_highEnergy.resize(nbNodes);
+	#pragma omp parallel for schedule(static)
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		m_highEnergy[i] = ((m_energy[i] - averageEnergy) / averageEnergy) > m_highEnergyThreshold;
+		m_energy[i] = 0;
+	}
+
+	// a node moves if it, or one of its neighbours, has a high energy. Each node reads its own neighbours so that the pass has no write conflict
+	#pragma omp parallel for schedule(static)
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		bool refine = m_highEnergy[i];
+		for (unsigned int k = m_adjOffsets[i]; k < m_adjOffsets[i + 1] && !refine; ++k)
+			refine = m_highEnergy[m_adjNodes[k]];
+		m_active[i] = refine && (!m_condition || m_movable[i]);
+	}
+	m_refineNodes.clear();
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		if (m_active[i])
+			m_refineNodes.push_back(i);
+	}
+	if (m_refineNodes.empty())
+		return;
+
+	// the refined nodes are movable, so they are all in the dynamic tree and the static one stays valid
+	m_activeNodes.swap(m_refineNodes);
+	m_refining = true;
+	mainLoop(m_refinementIterations);
+	m_refining = false;
+	m_activeNodes.swap(m_refineNodes);
+}
+
+template <typename Real>
+double BasicLayoutEngine<Real>::measureForceError() {
+	unsigned int nbNodes = m_x.size();
+	if (nbNodes == 0)
+		return 0;
+
+	// approximated forces of the movable nodes, the trees (or the grid) are built on the current positions
+	if (m_cutoff) {
+		buildCellGrid();
+	} else {
+		setupKdTrees();
+		if (m_nbStatic < nbNodes) {
+			buildKdTree(m_dynamicRoot);
+			gatherLeafPositions(m_nbStatic, nbNodes);
+		}
+	}
+	m_activeNodes.clear();
+	for (unsigned int i = 0; i < nbNodes; ++i) {
+		m_active[i] = !m_condition || m_movable[i];
+		if (m_active[i])
+			m_activeNodes.push_back(i);
+	}
+	std::fill(m_dx.begin(), m_dx.end(), 0);
+	std::fill(m_dy.begin(), m_dy.end(), 0);
+	if (m_fmm && !m_cutoff)
+		computeFmmForces(false);
+	(this->*REPULSION_PASSES[repulsionMode()][m_multipoleExpansion][false][false])();
+
+	// exact forces, every node being a source of the near-field kernel. The sums are reduced in the threads order
+	unsigned int nbThreads = m_threadDisp.size();
+	std::vector<double> threadError(nbThreads, 0);
+	std::vector<double> threadNorm(nbThreads, 0);
+	#pragma omp parallel num_threads(nbThreads)
+	{
+		double localError = 0;
+		double localNorm = 0;
+		#pragma omp for schedule(static) nowait
+		for (unsigned int a = 0; a < m_activeNodes.size(); ++a) {
+			unsigned int i = m_activeNodes[a];
+			Real exactX = 0, exactY = 0;
+			m_leafKernel(&m_x[i], &m_y[i], 1, m_x.data(), m_y.data(), nbNodes, m_Kr, &exactX, &exactY, nullptr);
+			double errorX = m_dx[i] - exactX;
+			double errorY = m_dy[i] - exactY;
+			localError += errorX * errorX + errorY * errorY;
+			localNorm += (double)exactX * exactX + (double)exactY * exactY;
+			m_dx[i] = 0;
+			m_dy[i] = 0;
+		}
+		threadError[threadId()] = localError;
+		threadNorm[threadId()] = localNorm;
+	}
+	double error = 0, norm = 0;
+	for (unsigned int t = 0; t < nbThreads; ++t) {
+		error += threadError[t];
+		norm += threadNorm[t];
+	}
+	return norm > 0 ? std::sqrt(error / norm) : 0;
+}
+
+template class BasicLayoutEngine<float>;
+template class BasicLayoutEngine<double>;
@@ -0,0 +1,804 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <complex>
+#include <functional>
+#include <vector>
+
+#include "counter_rng.h"
+#include "simd_kernels.h"
+#include "profiler.h"
+#include "snapshot.h"
+
+/**
+ * @brief 2d point, the engine does not depend on the Tulip types
+ */
+template <typename Real>
+struct BasicVec2 {
+	Real coords[2];
+
+	BasicVec2(Real x = 0, Real y = 0) : coords{x, y} {
+	}
+
+	Real x() const {
+		return coords[0];
+	}
+
+	Real y() const {
+		return coords[1];
+	}
+
+	BasicVec2 operator+(const BasicVec2 &v) const {
+		return BasicVec2(coords[0] + v.coords[0], coords[1] + v.coords[1]);
+	}
+
+	BasicVec2 operator*(Real f) const {
+		return BasicVec2(coords[0] * f, coords[1] * f);
+	}
+
+	BasicVec2 operator/(Real f) const {
+		return BasicVec2(coords[0] / f, coords[1] / f);
+	}
+};
+
+const unsigned int MAX_PTERM = 16; // Maximum number of terms of the p-term multipole expansion
+
+/**
+ * @brief Node of a kd-tree, stores the necessary information to approximate the repulsive forces.
+ * The nodes of a tree are stored in pre-order in a single array: the left child of a node is the next node in the array.
+ */
+template <typename Real>
+struct BasicKNode {
+	BasicVec2<Real> center; // Center of gravity of the vertices
+	Real radius; // Length between the center of gravity of the vertices and the farthest vertex
+	unsigned int start; // First index of the sub-list of vertices of LayoutEngine::m_order
+	unsigned int end; // Last index of the sub-list of vertices of LayoutEngine::m_order
+	unsigned int rightChild; // Index of the right child in the tree array, 0 if the node is a leaf
+	Real a0; // First coefficient of the multipole expansion
+	std::complex<Real> coefs[MAX_PTERM]; // Coefficents of the p-term sum, the k-th coefficient is divided by scale()^k
+
+	BasicKNode(unsigned int _start=0, unsigned int _end=0) 
+		: center(0), radius(0), start(_start), end(_end), rightChild(0), a0(0) {
+	}
+
+	bool isLeaf() const {
+		return rightChild == 0;
+	}
+
+	/**
+	 * @brief Length used to scale the expansions of the node, so that the powers of the coefficients neither overflow nor underflow
+	 */
+	Real scale() const {
+		return radius > 0 ? radius : Real(1);
+	}
+};
+
+/**
+ * @brief Level of the multilevel hierarchy: a graph in CSR form and the state of its nodes
+ */
+template <typename Real>
+struct BasicLayoutLevel {
+	std::vector<unsigned int> adjOffsets; // CSR adjacency: the neighbours of node i are adjNodes[adjOffsets[i]...adjOffsets[i+1]]
+	std::vector<unsigned int> adjNodes; // CSR adjacency: ids of the neighbours of each node
+	std::vector<unsigned int> parent; // Node of the next coarser level each node is merged into
+	FirstTouchVector<Real> x; // x coordinate of each node
+	FirstTouchVector<Real> y; // y coordinate of each node
+	FirstTouchVector<Real> nodeRadius; // Radius of the circle circumscribing each node
+	std::vector<char> movable; // Whether or not each node is able to move
+};
+
+const float DEFAULT_L = 10.0f;
+const float DEFAULT_KR = 100.0f;
+const float DEFAULT_KS = 1.0f;
+const float DEFAULT_INIT_TEMP = 200.0f;
+const float DEFAULT_INIT_TEMP_FACTOR = 0.2f;
+const float DEFAULT_COOLING_FACTOR = 0.95f;
+const float DEFAULT_THRESHOLD = 0.1f;
+const float DEFAULT_MAX_DISP = 200.0f;
+const float DEFAULT_HIGH_ENERGY_THRESHOlD = 1.0f;
+const float DEFAULT_CENTER_ATTR_FACTOR = 0.000001f;
+const float DEFAULT_REBUILD_THRESHOLD = 1.5f;
+const float DEFAULT_CUTOFF_RADIUS = 30.0f;
+const float DEFAULT_REST_THRESHOLD = 0.1f;
+const float DEFAULT_WAKE_THRESHOLD = 1.0f;
+const float DEFAULT_THETA = 1.0f;
+const unsigned int DEFAULT_ITERATIONS = 300;
+const unsigned int DEFAULT_REFINEMENT_ITERATIONS = 20;
+const unsigned int DEFAULT_REFINEMENT_FREQ = 30;
+const unsigned int DEFAULT_REST_ITERATIONS = 10;
+const unsigned int DEFAULT_MULTILEVEL_ITERATIONS = 50;
+const unsigned int DEFAULT_MAX_PARTITION_SIZE = 4;
+const unsigned int DEFAULT_PTERM = 4;
+const unsigned int DEFAULT_SEED = 0;
+
+/**
+ * @brief Parameters of the layout engine, see the parameters of the Custom Layout plugin
+ */
+struct LayoutParams {
+	bool constantTemp = false; // Whether or not the annealing temperature is constant
+	bool constantInitTemp = false; // Whether or not the initial annealing temperature is initTemp, else it depends on the size of the bounding box
+	bool blockNodes = false; // Whether or not only the movable nodes can move
+	bool multipoleExpansion = false; // Whether or not to use the multipole extension formula
+	bool fmm = false; // Whether or not to compute the repulsive forces with the Fast Multipole Method
+	bool cutoff = false; // Whether or not to only compute the repulsive forces between close nodes, with a uniform grid
+	bool interactionLists = false; // Whether or not to compute the repulsive forces leaf by leaf from interaction lists, reused until the kd-tree is rebuilt
+	bool adaptiveCooling = false; // Whether or not to use the local adaptive cooling strategy
+	bool stoppingCriterion = false; // Whether or not to stop the algo earlier if convergence has been detected
+	bool refinement = false; // Whether or not to use the refinement strategy
+	bool activeSet = false; // Whether or not to freeze the nodes at rest
+	bool multilevel = false; // Whether or not to lay out a hierarchy of coarsened graphs
+	bool components = false; // Whether or not to lay out each connected component on its own, concurrently
+	bool packComponents = true; // Whether or not to pack the components laid out on their own into rows (if components is true)
+	bool profile = false; // Whether or not to record the timings and counters of the profiler
+	bool pinThreads = false; // Whether or not to pin each thread to its own CPU during run(), spread over the sockets, and give each thread kd-tree subtrees of nodes (NUMA)
+	bool reorderNodes = false; // Whether or not to renumber the nodes along a Hilbert curve each time the kd-tree is rebuilt, so that close nodes are close in memory
+	float idealEdgeLength = DEFAULT_L;
+	float repulsiveStrength = DEFAULT_KR;
+	float springStrength = DEFAULT_KS;
+	float initTemp = DEFAULT_INIT_TEMP;
+	float initTempFactor = DEFAULT_INIT_TEMP_FACTOR;
+	float coolingFactor = DEFAULT_COOLING_FACTOR;
+	float convergenceThreshold = DEFAULT_THRESHOLD;
+	float maxDisp = DEFAULT_MAX_DISP;
+	float highEnergyThreshold = DEFAULT_HIGH_ENERGY_THRESHOlD;
+	float centerAttrFactor = DEFAULT_CENTER_ATTR_FACTOR;
+	float rebuildThreshold = DEFAULT_REBUILD_THRESHOLD;
+	float cutoffRadius = DEFAULT_CUTOFF_RADIUS;
+	float restThreshold = DEFAULT_REST_THRESHOLD;
+	float wakeThreshold = DEFAULT_WAKE_THRESHOLD;
+	float snapshotInterval = 0.0f; // Minimum time between two snapshots of the positions in seconds (see setSnapshotCallback), 0 for none
+	float timeBudget = 0.0f; // Wall-clock budget of run() in seconds: the layout is returned when it runs out, and the cooling is fitted to it. 0 for no budget
+	float theta = DEFAULT_THETA; // Opening criterion of the kd-tree: a cell is approximated if its radius is lower than theta times its distance, in ]0, 1]
+	unsigned int iterations = DEFAULT_ITERATIONS;
+	unsigned int refinementIterations = DEFAULT_REFINEMENT_ITERATIONS;
+	unsigned int refinementFreq = DEFAULT_REFINEMENT_FREQ;
+	unsigned int restIterations = DEFAULT_REST_ITERATIONS;
+	unsigned int multilevelIterations = DEFAULT_MULTILEVEL_ITERATIONS;
+	unsigned int maxPartitionSize = DEFAULT_MAX_PARTITION_SIZE;
+	unsigned int snapshotIterations = 0; // Number of iterations between two snapshots of the positions (see setSnapshotCallback), 0 for none
+	unsigned int pTerm = DEFAULT_PTERM; // Number of terms of the multipole expansions, in [1, MAX_PTERM]
+	unsigned int seed = DEFAULT_SEED;
+};
+
+/**
+ * @brief Force-directed layout engine working on plain arrays, independent of Tulip.
+ * The graph is given once in CSR form, with the ids of the nodes being their index in the arrays.
+ * Usage: construct it with the parameters, give it a graph with setGraph, call run, and read the positions with x() and y().
+ */
+template <typename Real>
+class BasicLayoutEngine {
+public:
+	typedef BasicVec2<Real> Vec2;
+	typedef BasicKNode<Real> KNode;
+	typedef BasicLayoutLevel<Real> LayoutLevel;
+
+	BasicLayoutEngine(const LayoutParams &params = LayoutParams());
+
+	/**
+	 * @brief Copies the graph and the initial state of its nodes into the engine
+	 * @param nbNodes Number of nodes
+	 * @param x Initial x coordinate of each node, in the precision of the engine
+	 * @param y Initial y coordinate of each node, in the precision of the engine
+	 * @param width Width of each node
+	 * @param height Height of each node
+	 * @param adjOffsets CSR adjacency, nbNodes + 1 offsets: the neighbours of node i are adjNodes[adjOffsets[i]...adjOffsets[i+1]]
+	 * @param adjNodes CSR adjacency, each edge is stored once for both of its extremities
+	 * @param movable Whether or not each node is able to move (only taken into account if blockNodes is true), all the nodes can move if null
+	 */
+	void setGraph(unsigned int nbNodes, const Real *x, const Real *y, const Real *width, const Real *height, 
+		const unsigned int *adjOffsets, const unsigned int *adjNodes, const char *movable = nullptr);
+
+	/**
+	 * @brief Computes the layout of the graph
+	 * @return The number of iterations done (see mainLoop)
+	 */
+	unsigned int run();
+
+	const FirstTouchVector<Real> &x() const {
+		return m_x;
+	}
+
+	const FirstTouchVector<Real> &y() const {
+		return m_y;
+	}
+
+	/**
+	 * @brief Whether or not each node had a high energy during the last refinement step, empty if there was none
+	 */
+	const std::vector<char> &highEnergy() const {
+		return m_highEnergy;
+	}
+
+	Profiler &profiler() {
+		return m_profiler;
+	}
+
+	/**
+	 * @brief Sets a function called between the iterations with the number of iterations done and planned by the current loop. 
+	 * The run stops as soon as it returns true, and the positions of the last complete iteration are kept
+	 */
+	void setStopCallback(const std::function<bool(unsigned int, unsigned int)> &callback) {
+		m_stopCallback = callback;
+	}
+
+	/**
+	 * @brief Sets a function called with a copy of the positions of the nodes every snapshotIterations iterations and/or every snapshotInterval seconds.
+	 * It is called by a reader thread while the run goes on (see SnapshotPublisher), the snapshots published while it is busy replace each other. It must not touch data that the thread calling run() uses without synchronisation.
+	 * The multilevel mode only publishes the finest level, the components mode the positions after each component laid out with all the threads, then every snapshotIterations small components handled (and/or every snapshotInterval seconds) while they are laid out concurrently
+	 */
+	void setSnapshotCallback(const typename SnapshotPublisher<Real>::Callback &callback) {
+		m_snapshotCallback = callback;
+	}
+
+	/**
+	 * @brief Whether or not the last run was stopped before the end, by the stop callback or the time budget
+	 */
+	bool stopped() const {
+		return m_stopped;
+	}
+
+	/**
+	 * @brief Measures the error of the repulsive forces computed by the current mode at the current positions, against the exact O(n^2) summation.
+	 * Meant to choose the accuracy parameters (p-term, theta), not to be called while laying out.
+	 * @return The relative RMS error sqrt(sum |F - F_exact|^2 / sum |F_exact|^2) over the movable nodes
+	 */
+	double measureForceError();
+
+private:
+	bool m_cstTemp; // Whether or not the annealing temperature is constant
+	bool m_cstInitTemp; // Whether or not the initial annealing temperature is predefined. If false, it is the the initial temperature is sqrt(|V|) 
+	bool m_condition; // Whether or not to block certain nodes.
+	bool m_multipoleExpansion; // Whether or not to use the multipole extension formula
+	bool m_fmm; // Whether or not to compute the repulsive forces with the Fast Multipole Method (cell to cell interactions)
+	bool m_cutoff; // Whether or not to only compute the repulsive forces between close nodes, with a uniform grid instead of the kd-tree
+	bool m_interactionLists; // Whether or not to compute the repulsive forces of the kd-tree leaf by leaf from their interaction lists (unless m_fmm or m_cutoff is true)
+	bool m_adaptiveCooling; // Whether or not to use the local adaptive cooling strategy
+	bool m_stoppingCriterion; // Whether or not to stop the algo earlier if convergence has been detected
+	bool m_refinement; // Whether or not to use the refinement strategy.
+	bool m_activeSet; // Whether or not to freeze the nodes that have been at rest for a while, until something moves around them
+	bool m_multilevel; // Whether or not to lay out a hierarchy of coarsened graphs, from the coarsest to the graph itself
+	bool m_profile; // Whether or not to record the timings and counters of the profiler
+	bool m_components; // Whether or not to lay out each connected component on its own, with its own engine
+	bool m_packComponents; // Whether or not to pack the components laid out on their own
+	bool m_attract; // Whether or not the nodes are attracted toward the center, when the graph is not connected (and its components are laid out together)
+	LayoutParams m_params; // Parameters of the engine, given to the engines of the components
+	Real m_L; // Ideal edge length
+	Real m_Kr; // Repulsive force constant
+	Real m_Ks; // Spring force constant
+	Real m_initTemp; // Initial annealing temperature (if m_cstInitTemp is true)
+	Real m_initTempFactor; // Factor to apply on the initial annealing temperature (if m_cstInitTemp is false)
+	Real m_coolingFactor; // Cooling rate of the annealing temperature
+	Real m_temp; // Global temperature of the graph
+	Real m_threshold; // The convergence threshold
+	Real m_maxDisp; // Maximum displament allowed for nodes.
+	Real m_dispCap; // Maximum displacement of the adaptive cooling, m_maxDisp unless it is cooled down to fit the time budget
+	Real m_highEnergyThreshold; // Threshold that determines if a node has a high energy => how many times the distance between the node's energy and the avg energy 
+	Real m_centerAttrFactor; // center attraction factor
+	Real m_rebuildThreshold; // The kd-tree is rebuilt when the radii of its leaves (relative to the root's) have grown by more than this factor since the last rebuild, else it is refitted
+	Real m_cutoffRadius; // Size of the cells of the uniform grid, only the nodes of the 3x3 neighbouring cells repulse a node (if m_cutoff is true)
+	Real m_restThreshold; // A node whose displacement is below this threshold is at rest
+	Real m_wakeThreshold; // A frozen node is woken up when a neighbour or a node of its kd-tree leaf (or grid cell) moved more than this threshold
+	Real m_theta; // Opening criterion of the kd-tree: a cell is approximated if its radius is lower than m_theta times its distance
+	Real m_builtLeafRadius; // Sum of the radii of the dynamic kd-tree leaves divided by the root's radius after the last rebuild, 0 if the tree has never been built or must be rebuilt (all the nodes on the same point)
+	unsigned int m_nbStatic; // Number of blocked nodes, stored first in m_order and partitioned by the static kd-tree (if m_condition is true)
+	unsigned int m_dynamicRoot; // Index in m_tree of the root of the dynamic kd-tree (movable nodes), 0 if there is no static kd-tree
+	bool m_refining; // Whether or not the main loop is running a refinement pass: only the nodes of m_refineNodes move, and the trees are reused
+	bool m_pinThreads; // Whether or not to pin the threads to their CPU during run()
+	bool m_reorderNodes; // Whether or not the main loop renumbers the nodes along a Hilbert curve after each rebuild of the dynamic kd-tree
+	bool m_subtreeOrder; // Whether or not the main loop renumbers the nodes in the kd-tree order after each rebuild, so that the static chunk of nodes of each (pinned) thread is made of whole subtrees. Takes precedence over m_reorderNodes
+	ThreadPinning m_pinning; // Affinity of the threads before they were pinned
+	bool m_stopped; // Whether or not the current run has been stopped by m_stopCallback or the time budget
+	double m_timeBudget; // Wall-clock budget of run() in seconds, 0 for no budget
+	std::chrono::steady_clock::time_point m_deadline; // The run stops at this time (if m_timeBudget > 0)
+	std::chrono::steady_clock::time_point m_loopDeadline; // The cooling of the current main loop is fitted to end at this time (a share of the budget if m_multilevel is true)
+	std::function<bool(unsigned int, unsigned int)> m_stopCallback; // Polled between the iterations, the run stops when it returns true
+	unsigned int m_snapshotIterations; // Number of iterations between two snapshots, 0 for none
+	double m_snapshotInterval; // Minimum time between two snapshots in seconds, 0 for none
+	bool m_snapshotting; // Whether or not the current main loop publishes snapshots (false on the coarse levels of the multilevel mode)
+	std::chrono::steady_clock::time_point m_lastSnapshot; // Time of the last snapshot
+	typename SnapshotPublisher<Real>::Callback m_snapshotCallback; // Reads the snapshots, none if empty
+	SnapshotPublisher<Real> m_snapshots; // Double buffer of the snapshots and reader thread, running during run() if m_snapshotCallback is set
+	unsigned int m_iterations; // Number of iterations
+	unsigned int m_refinementIterations; // Number of iterations of the refinement process
+	unsigned int m_refinementFreq; // Number of iterations in between refinement steps
+	unsigned int m_restIterations; // Number of consecutive iterations at rest after which a node is frozen (if m_activeSet is true)
+	unsigned int m_multilevelIterations; // Number of iterations on each level of the multilevel hierarchy but the coarsest one
+	unsigned int m_maxPartitionSize; // Maximum number of nodes of the smallest partition of the graph (via KD-tree)
+	unsigned int m_pTerm; // Number of term to compute in the p-term multipole expansion
+	unsigned int m_seed; // Seed of the random streams, a given seed and thread count always gives the same layout
+	unsigned int m_step; // Number of iterations done since the start of the algo (refinement included), identifies the random streams of an iteration
+	std::vector<unsigned int> m_order; // Ids of the nodes, rearranged by the kd-tree, /!\ the order is NOT fixed
+	std::vector<unsigned int> m_nodeIds; // Id given by setGraph of each node while the main loop has renumbered them (see reorderNodes), empty if they are in their original order
+	std::vector<unsigned int> m_partitionBuffer; // Target of the parallel partitions of m_order (see parallelSelect)
+	std::vector<unsigned int> m_adjOffsets; // CSR adjacency: the neighbours of node i are m_adjNodes[m_adjOffsets[i]...m_adjOffsets[i+1]]
+	std::vector<unsigned int> m_adjNodes; // CSR adjacency: dense ids of the neighbours of each node
+	std::vector<unsigned int> m_component; // Connected component of each node
+	unsigned int m_nbComponents; // Number of connected components
+	FirstTouchVector<Real> m_x; // Current x coordinate of each node
+	FirstTouchVector<Real> m_y; // Current y coordinate of each node
+	FirstTouchVector<Real> m_dx; // Displacement of each node along x
+	FirstTouchVector<Real> m_dy; // Displacement of each node along y
+	FirstTouchVector<Real> m_dxPrev; // Displacement of each node along x during the previous iteration
+	FirstTouchVector<Real> m_dyPrev; // Displacement of each node along y during the previous iteration
+	FirstTouchVector<Real> m_energy; // Current energy of each node
+	FirstTouchVector<Real> m_nodeRadius; // Radius of the circle circumscribing each node
+	struct InteractionList {
+		std::vector<unsigned int> near; // Source leaves whose nodes interact exactly with the nodes of the target leaf
+		std::vector<unsigned int> far; // Source cells that are approximated for all the nodes of the target leaf
+	};
+	std::vector<KNode> m_tree; // kd-trees of the nodes, in pre-order: the static tree of the blocked nodes then the dynamic tree of the movable ones. Their topology only depends on the number of nodes so it is reused across iterations
+	std::vector<std::complex<Real>> m_localCoefs; // Coefficients b1...bp of the local expansion of each kd-tree node (FMM), MAX_PTERM per node, the l-th coefficient is multiplied by scale()^l
+	std::vector<Real> m_localEnergy; // Energy received by each kd-tree node from the well-separated cells (FMM)
+	std::vector<unsigned int> m_listLeaves; // Leaves of the dynamic kd-tree, the targets of the interaction lists
+	std::vector<InteractionList> m_lists; // Interaction list of each leaf of m_listLeaves, the vectors keep their capacity across rebuilds
+	bool m_listsValid; // Whether or not the interaction lists match the topology and partition of the kd-trees, they are built again after each rebuild
+	FirstTouchVector<Real> m_leafX; // x coordinate of the nodes in the kd-tree order (m_order), so that the nodes of a leaf are contiguous
+	FirstTouchVector<Real> m_leafY; // y coordinate of the nodes in the kd-tree order (m_order)
+	std::vector<unsigned int> m_nodeCell; // Cell of the uniform grid containing each node
+	std::vector<unsigned int> m_cellStart; // Nodes of cell c are at m_cellX/Y[m_cellStart[c]...m_cellStart[c+1]], cells are stored row by row
+	std::vector<Real> m_cellX; // x coordinate of the nodes sorted by cell
+	std::vector<Real> m_cellY; // y coordinate of the nodes sorted by cell
+	std::vector<unsigned int> m_cellNodes; // Dense ids of the nodes sorted by cell
+	unsigned int m_cellCols; // Number of columns of the uniform grid
+	unsigned int m_cellRows; // Number of rows of the uniform grid
+	Profiler m_profiler; // Per-phase timings and counters, disabled unless m_profile is true
+	simd::LeafKernel<Real> m_leafKernel; // Near-field kernel, the widest one supported by the CPU
+	std::vector<char> m_movable; // Whether or not each node is able to move (only taken into account if m_condition is true)
+	FirstTouchVector<char> m_active; // Whether or not each node is processed during the current iteration: movable and not frozen
+	std::vector<unsigned int> m_activeNodes; // Dense ids of the active nodes, in increasing order. The force and update loops only go through them
+	FirstTouchVector<unsigned int> m_restCount; // Number of consecutive iterations each node has been at rest
+	FirstTouchVector<Real> m_lastDisp; // Length of the last displacement of each node
+	std::vector<char> m_highEnergy; // Whether or not each node had a high energy during the last refinement step, empty if there was none
+	std::vector<unsigned int> m_refineNodes; // Dense ids of the nodes moved by the current refinement pass: the high energy nodes and their neighbours
+	std::vector<double> m_threadDisp; // Sum of the displacements of each thread during the last update
+	std::vector<double> m_threadEnergy; // Sum of the energies of each thread during the last update
+	Vec2 m_center; // Center of the bounding box of the initial positions
+
+	/**
+	 * @brief Labels the connected components of the graph (CSR adjacency) into m_component and m_nbComponents
+	 */
+	void labelComponents();
+
+	/**
+	 * @brief Initialises the temperature, the center and the buffers of the algo once the graph is set
+	 * @param minX, maxX, minY, maxY The bounding box of the nodes
+	 */
+	void initState(Real minX, Real maxX, Real minY, Real maxY);
+
+	/**
+	 * @brief Copies a connected component of another engine into this one
+	 * @param parent The engine of the whole graph
+	 * @param nodes The dense ids of the nodes of the component in parent, their index in this array is their id in this engine
+	 * @param nbNodes The number of nodes of the component
+	 * @param localId The id of each node of parent in the engine of its component
+	 */
+	void setSubgraph(const BasicLayoutEngine &parent, const unsigned int *nodes, unsigned int nbNodes, const std::vector<unsigned int> &localId);
+
+	/**
+	 * @brief Lays out each connected component with its own engine: the large components one after the other, each with all the threads,
+	 * and the small ones concurrently, one task each. Then packs the components (see packComponents).
+	 * @return The largest number of iterations done on a component
+	 */
+	unsigned int componentLoop();
+
+	/**
+	 * @brief Packs the components into rows, the highest first (shelf packing), separated by the ideal edge length. 
+	 * The packing is centered on the center of the initial bounding box. The components with blocked nodes (if m_condition is true) do not move,
+	 * the rows are then placed under them.
+	 * @param compStart The nodes of component c are compNodes[compStart[c]...compStart[c+1]]
+	 * @param compNodes The dense ids of the nodes sorted by component
+	 */
+	void packComponents(const std::vector<unsigned int> &compStart, const std::vector<unsigned int> &compNodes);
+
+	/**
+	 * @brief Sizes the buffers of the algo (displacements, kd-tree, etc) from the positions in m_x and m_y
+	 */
+	void initBuffers();
+
+	/**
+	 * @brief Main loop of the simulation, computes the drawing and stops after a certain number of iterations or until convergence 
+	 * @return The number of iterations done: the iterations whose displacements were applied, not counting the refinement passes nor the iterations without active node
+	 */
+	unsigned int mainLoop(unsigned int maxIterations);
+
+	/**
+	 * @brief Checks whether the run must stop: polls m_stopCallback between the iterations, and the time budget between the iterations and phases
+	 * @param done, total The number of iterations done and planned by the current loop, total is 0 between phases (the callback is not polled)
+	 * @return m_stopped
+	 */
+	bool checkStop(unsigned int done, unsigned int total);
+
+	/**
+	 * @brief Publishes a snapshot of the positions if m_snapshotIterations iterations or m_snapshotInterval seconds have passed since the last one
+	 * @param force Whether or not to publish it anyway
+	 */
+	void snapshot(bool force);
+
+	/**
+	 * @brief Renumbers the nodes in the order of their Hilbert index in the bounding box, so that the nodes of a kd-tree leaf, the neighbours of a node 
+	 * and the nodes processed by a thread are mostly contiguous in the per-node arrays. If m_subtreeOrder is true, the nodes are renumbered in the order 
+	 * of the kd-trees instead: each thread processes and first touches the nodes of a few whole subtrees. Only called by the main loop after a rebuild of the dynamic kd-tree, 
+	 * the original order is restored before it returns (restoreNodeOrder)
+	 */
+	void reorderNodes();
+
+	/**
+	 * @brief Moves the per-node arrays to pages first touched by the current threads (see retouch), called once they are pinned
+	 */
+	void retouchNodeArrays();
+
+	/**
+	 * @brief Renumbers the nodes to their original ids (see m_nodeIds)
+	 */
+	void restoreNodeOrder();
+
+	/**
+	 * @brief Moves the nodes to new ids: the per-node arrays and the CSR adjacency are permuted, and the lists of ids (m_order, m_activeNodes, etc) are renumbered
+	 * @param perm The current id of the node that gets the id k, for each k
+	 */
+	void permuteNodes(const std::vector<unsigned int> &perm);
+
+	/**
+	 * @brief Cools the temperature (or the maximum displacement of the adaptive cooling) after an iteration of a budgeted main loop.
+	 * If the remaining iterations do not fit in the remaining time at the pace of the done ones, the temperature is cooled down 
+	 * geometrically to reach finalTemp in the iterations that fit, so that a layout returned early is still annealed. Else it is cooled as usual
+	 * @param loopStart The start time of the main loop
+	 * @param it, maxIterations The number of iterations done and planned by the main loop
+	 * @param finalTemp The temperature at the end of the usual cooling schedule
+	 */
+	void fitCooling(std::chrono::steady_clock::time_point loopStart, unsigned int it, unsigned int maxIterations, Real finalTemp);
+
+	/**
+	 * @brief How the repulsive forces are computed, see repulsionMode
+	 */
+	enum RepulsionMode {
+		TREE_REPULSION, // traversal of the kd-trees for each node
+		LIST_REPULSION, // interaction lists of the kd-tree leaves (m_interactionLists)
+		FMM_REPULSION, // cell to cell interactions, computed before the pass (m_fmm)
+		CUTOFF_REPULSION, // close nodes of the uniform grid (m_cutoff)
+		NB_REPULSION_MODES
+	};
+
+	/**
+	 * @brief Returns the mode of the repulsive forces: m_cutoff takes precedence over m_fmm, which takes precedence over m_interactionLists
+	 */
+	RepulsionMode repulsionMode() const {
+		if (m_cutoff)
+			return CUTOFF_REPULSION;
+		if (m_fmm)
+			return FMM_REPULSION;
+		return m_interactionLists ? LIST_REPULSION : TREE_REPULSION;
+	}
+
+	typedef void (BasicLayoutEngine::*Pass)();
+	static const Pass REPULSION_PASSES[NB_REPULSION_MODES][2][2][2]; // repulsionPass (or listRepulsionPass) specializations, indexed by [repulsionMode()][m_multipoleExpansion][m_attract][energy]
+	static const Pass ATTRACTION_PASSES[2]; // attractionPass specializations, indexed by [energy]
+	static const Pass UPDATE_PASSES[2][2]; // updatePass specializations, indexed by [m_adaptiveCooling][energy]
+
+	/**
+	 * @brief Computes the repulsive forces of the active nodes (kd-tree or grid, the FMM forces are computed beforehand), and the attraction toward the center.
+	 * @tparam MODE TREE_REPULSION, FMM_REPULSION or CUTOFF_REPULSION (LIST_REPULSION is listRepulsionPass)
+	 * @tparam MULTIPOLE If true, the far cells of the kd-tree are approximated by their multipole expansion
+	 * @tparam ATTRACT If true, the nodes are attracted toward the center (m_attract)
+	 * @tparam ENERGY If true, computes the nodes' energy (for the refinement step)
+	 */
+	template <RepulsionMode MODE, bool MULTIPOLE, bool ATTRACT, bool ENERGY>
+	void repulsionPass();
+
+	/**
+	 * @brief Computes the repulsive forces of the nodes of the dynamic kd-tree leaves that hold an active node from the interaction lists of the leaves
+	 * (built beforehand if they are not valid), and the attraction toward the center. Each leaf streams its near leaves through the near-field kernel
+	 * and its far cells through a loop over its nodes, the forces are then scattered to its active nodes
+	 * @tparam MULTIPOLE If true, the far cells are approximated by their multipole expansion
+	 * @tparam ATTRACT If true, the nodes are attracted toward the center (m_attract)
+	 * @tparam ENERGY If true, computes the nodes' energy (for the refinement step)
+	 */
+	template <bool MULTIPOLE, bool ATTRACT, bool ENERGY>
+	void listRepulsionPass();
+
+	/**
+	 * @brief Computes the attractive forces of the active nodes, each node gathers the forces from its own neighbours
+	 * @tparam ENERGY If true, computes the nodes' energy (for the refinement step)
+	 */
+	template <bool ENERGY>
+	void attractionPass();
+
+	/**
+	 * @brief Cools and applies the displacements of the active nodes. The sums of the displacements and energies of each thread are written to m_threadDisp and m_threadEnergy
+	 * @tparam ADAPTIVE If true, uses the local adaptive cooling, else the global temperature
+	 * @tparam ENERGY If true, sums the nodes' energy (for the refinement step)
+	 */
+	template <bool ADAPTIVE, bool ENERGY>
+	void updatePass();
+
+	/**
+	 * @brief Multilevel layout (V-cycle): coarsens the graph into a hierarchy by matching neighbours, lays out the coarsest level with mainLoop, 
+	 * and then interpolates the positions and refines them level by level with few iterations.
+	 * @return The number of iterations done on all the levels
+	 */
+	unsigned int multilevelLoop();
+
+	/**
+	 * @brief Builds the next coarser level: the nodes of fine are visited in a random order and merged with their unmatched neighbour of lowest degree.
+	 * @param fine The level to coarsen, its parent mapping is filled
+	 * @param coarse The coarser level to build, its nodes are at the barycenter of the nodes they merge
+	 * @param level The depth of the coarser level in the hierarchy
+	 */
+	void coarsenLevel(LayoutLevel &fine, LayoutLevel &coarse, unsigned int level);
+
+	/**
+	 * @brief Places the movable nodes of fine around the position of the node they were merged into
+	 * @param fine The level to interpolate
+	 * @param coarse The next coarser level, already laid out
+	 * @param level The depth of fine in the hierarchy
+	 */
+	void prolongLevel(LayoutLevel &fine, const LayoutLevel &coarse, unsigned int level);
+
+	/**
+	 * @brief Exchanges the graph and the positions of a level with the ones the algo currently works on
+	 */
+	void swapLevel(LayoutLevel &level);
+
+	/**
+	 * @brief Computes local temperature for each node 
+	 * @param i The dense id of the node to compute the local temperature from
+	 * @return Real The local temperature of the node
+	 */
+	Real adaptativeCool(unsigned int i);
+
+	/**
+	 * @brief Computes the center of the circle circumscribing the set of vertices m_order[start...end]
+	 * @param start The start index of the set
+	 * @param end The end index of the set
+	 * @return Vec2 The center of the circle circumscribing the set of vertices m_order[start...end]
+	 */
+	Vec2 computeCenter(unsigned int start, unsigned int end);
+
+	/**
+	 * @brief Computes the radius of the circle circumscribing the set of vertices m_order[start...end]
+	 * @param start The start index of the set
+	 * @param end The end index of the set
+	 * @param center The center coordinate of the set of nodes
+	 * @return Real The radius of the circle circumscribing the set of vertices m_order[start...end]
+	 */
+	Real computeRadius(unsigned int start, unsigned int end, Vec2 center);
+
+	/**
+	 * @brief Allocates the nodes of the kd-tree in m_tree, in pre-order. The range of a node is split at its median, 
+	 * its children are leaves if one of them has less than m_maxPartitionSize vertices.
+	 * @param start The start index of the range of vertices of the node
+	 * @param end The end index of the range of vertices of the node
+	 * @param split Whether or not the node has children
+	 * @return unsigned int The index of the node in m_tree
+	 */
+	unsigned int buildKdTreeTopology(unsigned int start, unsigned int end, bool split);
+
+	/**
+	 * @brief Auxiliary function of buildKdTree, builds a subtree on the calling thread, spawning a task per child above TASK_GRAIN nodes.
+	 * The center of the node must be set: its radius and the centers of its children are computed in the same pass (see splitKdNode)
+	 * @param index The index of the kd-tree node to build
+	 * @param level Node's depth in the kd-tree. The depth of the root node is 0.
+	 */
+	void buildKdTreeAux(unsigned int index, unsigned int level);
+
+	/**
+	 * @brief Builds the top levels of a kd-tree, each node with more than PARALLEL_PARTITION_SIZE nodes being partitioned by all the threads.
+	 * The center of the node must be set.
+	 * @param index, level See buildKdTreeAux
+	 * @param subtrees The roots (index, level) of the subtrees left to buildKdTreeAux
+	 * @param topNodes The internal nodes built, in pre-order
+	 */
+	void buildKdTreeTop(unsigned int index, unsigned int level, std::vector<std::pair<unsigned int, unsigned int>> &subtrees, std::vector<unsigned int> &topNodes);
+
+	/**
+	 * @brief Rearranges the vertices of a kd-tree node around the median of its children, along x on the even levels and y on the odd ones
+	 * @param parallel Whether or not to select the median with all the threads (see parallelSelect)
+	 */
+	void partitionKdNode(unsigned int index, unsigned int level, bool parallel);
+
+	/**
+	 * @brief Selects the vertex of m_order at median along x or y, with all the threads: the range is 3-way partitioned around a sampled pivot 
+	 * in parallel (blocks counted, then scattered through m_partitionBuffer) until the part holding the median is small enough for nth_element
+	 */
+	void parallelSelect(unsigned int start, unsigned int median, unsigned int end, bool alongX);
+
+	/**
+	 * @brief Computes the radius of a partitioned kd-tree node and the centers of its children (or only its radius if it is a leaf) in a single pass over its vertices
+	 * @param parallel Whether or not to split the pass between the threads, the partial results are reduced in the order of the blocks
+	 */
+	void splitKdNode(unsigned int index, bool parallel);
+
+	/**
+	 * @brief Sets the topology of the kd-trees, and builds the static one. If m_condition is true, the blocked nodes are partitioned by a static tree
+	 * that is only built once (their positions and multipole expansions do not change), and the movable ones by a dynamic tree.
+	 */
+	void setupKdTrees();
+
+	/**
+	 * @brief Rebuilds a 2d-tree of m_tree from the current positions. Wrapper function of buildKdTreeAux.
+	 * Vertices on the even levels of the tree are sorted horizontally, and vertically on the odd levels.
+	 * @param index The index of the root of the tree (0 or m_dynamicRoot)
+	 */
+	void buildKdTree(unsigned int index);
+
+	/**
+	 * @brief Refits the dynamic kd-tree to the current positions without changing its partition: the centers, radii and coefficients are updated bottom-up.
+	 * Rebuilds the tree instead if the refitted tree is too loose (see m_rebuildThreshold).
+	 * @return bool Whether or not the tree was rebuilt
+	 */
+	bool refitKdTree();
+
+	/**
+	 * @brief Auxiliary function of refitKdTree.
+	 * @param index The index of the kd-tree node to refit
+	 * @return Real The sum of the radii of the leaves of the node
+	 */
+	Real refitKdTreeAux(unsigned int index);
+
+	/**
+	 * @brief Computes the sum of the radii of the leaves of a kd-tree.
+	 * @param index The index of the root of the tree (0 or m_dynamicRoot)
+	 */
+	Real leafRadiusSum(unsigned int index) const;
+
+	/**
+	 * @brief Computes the coefficients of the multipole expansion of a leaf from its vertices (P2M).
+	 * @param node The node of the kd-tree on which to compute the coefficients.
+	 */
+	void computeCoef(KNode &node);
+
+	/**
+	 * @brief Computes the coefficients of the multipole expansion of an internal node by shifting the expansions of its children to its center (M2M),
+	 * in O(p^2) instead of O(p * number of vertices). The children's coefficients must be up to date.
+	 * @param index The index of the internal node in m_tree
+	 */
+	void shiftCoefs(unsigned int index);
+
+	/**
+	 * @brief Computes the repulsives forces that the node is subect to
+	 * @param i The dense id of the node on which to compute the forces
+	 * @param index The index of the kd-tree node used to approximate the forces
+	 * @param rng The random stream of the node
+	 * @tparam MULTIPOLE If true, the far cells are approximated by their multipole expansion, else by their center
+	 * @tparam ENERGY If true, computes the node's energy (for the refinement step) 
+	 */
+	template <bool MULTIPOLE, bool ENERGY>
+	void computeReplForces(unsigned int i, unsigned int index, CounterRng &rng);
+
+	/**
+	 * @brief Lists the leaves of the dynamic kd-tree into m_listLeaves, and builds their interaction lists by walking each leaf down the static and dynamic trees
+	 */
+	void buildInteractionLists();
+
+	/**
+	 * @brief Adds the cells of a kd-tree to the interaction list of a target leaf. A cell is far if its radius is lower than m_theta times its distance
+	 * to the closest point of the leaf's bounding circle, so that it is far for every node of the leaf; a leaf that is not far is near, else the recursion continues
+	 * @param target The target leaf
+	 * @param index The index of the kd-tree node tested against the leaf
+	 * @param list The interaction list of the target
+	 */
+	void listInteractions(const KNode &target, unsigned int index, InteractionList &list);
+
+	/**
+	 * @brief Copies the positions of the nodes m_order[start...end] in the kd-tree order into m_leafX and m_leafY 
+	 */
+	void gatherLeafPositions(unsigned int start, unsigned int end);
+
+	/**
+	 * @brief Computes the exact repulsive forces that the vertices of a leaf exert on a node
+	 * @param i The dense id of the node on which to compute the forces
+	 * @param leaf The leaf of the kd-tree
+	 * @tparam ENERGY If true, computes the node's energy (for the refinement step) 
+	 */
+	template <bool ENERGY>
+	void computeLeafForces(unsigned int i, const KNode &leaf);
+
+	/**
+	 * @brief Wakes up the frozen nodes that have a moving neighbour or a moving node in their kd-tree leaf (or grid cell),
+	 * and lists the active nodes (movable and not frozen) into m_active and m_activeNodes.
+	 */
+	void scheduleActiveNodes();
+
+	/**
+	 * @brief Sorts the nodes into a uniform grid of cells of size m_cutoffRadius covering their bounding box (counting sort over the cell ids, linear time).
+	 * The grid is coarsened if it would have much more cells than nodes.
+	 */
+	void buildCellGrid();
+
+	/**
+	 * @brief Computes the exact repulsive forces that the nodes of the 3x3 cells around a node exert on it, the other nodes are ignored
+	 * @param i The dense id of the node on which to compute the forces
+	 * @tparam ENERGY If true, computes the node's energy (for the refinement step) 
+	 */
+	template <bool ENERGY>
+	void computeCellForces(unsigned int i);
+
+	/**
+	 * @brief Computes the repulsive forces of all the movable nodes with the Fast Multipole Method:
+	 * the multipole expansions of well-separated cells are translated into local expansions (M2L), 
+	 * the local expansions are pushed down the tree (L2L) and evaluated at the nodes (L2P).
+	 * @param computeEnergy If true, computes the nodes' energy (for the refinement step) 
+	 */
+	void computeFmmForces(bool computeEnergy);
+
+	/**
+	 * @brief Dual tree traversal of the FMM: translates the expansion of source into the local expansion of target if they are well-separated,
+	 * computes the exact forces if they are both leaves, else splits the biggest cell. Only writes to target's subtree.
+	 * @param target The index of the kd-tree node receiving the forces
+	 * @param source The index of the kd-tree node exerting the forces
+	 * @param computeEnergy If true, computes the nodes' energy (for the refinement step) 
+	 */
+	void fmmInteract(unsigned int target, unsigned int source, bool computeEnergy);
+
+	/**
+	 * @brief Downward pass of the FMM: pushes the local expansion of a kd-tree node to its children, and evaluates it at the nodes of the leaves.
+	 * @param index The index of the kd-tree node
+	 * @param computeEnergy If true, computes the nodes' energy (for the refinement step) 
+	 */
+	void fmmDownward(unsigned int index, bool computeEnergy);
+
+	/**
+	 * @brief Refine the drawing : detect high energy nodes and run a simulation allowing only them and their neighbours to move.
+	 * The pass reuses the trees and the buffers of the main loop, the force and update loops only go through m_refineNodes.
+	 * @param totalEnergy Sum of the energies of the nodes
+	 */
+	void computeRefinement(double totalEnergy);
+
+	/**
+	 * @brief Returns the random stream of a node for the current iteration
+	 * @param i The dense id of the node
+	 * @param phase Index of the phase of the iteration using the stream
+	 */
+	CounterRng nodeRng(unsigned int i, unsigned int phase) {
+		unsigned int id = m_nodeIds.empty() ? i : m_nodeIds[i]; // the streams follow the nodes when they are renumbered
+		return CounterRng(m_seed, (uint64_t(m_step) << 33) | (uint64_t(id) << 1) | phase);
+	}
+
+	/**
+	 * @brief Computes the repulsive force between two nodes
+	 * @param distNorm The distance between nodes
+	 * @param rng The random stream used to push apart nodes at the same position
+	 * @return Real The magnitude of the force
+	 */
+	Real computeReplForce(Real distNorm, CounterRng &rng) {
+		if (distNorm == 0) // push the nodes apart slightly 
+			return rng.uniform();
+		// return m_Kr / (dist_norm * dist_norm * dist_norm);
+		return m_Kr / (distNorm * distNorm);
+	}
+
+	/**
+	 * @brief Computes the attractive force between two nodes
+	 * @param distNorm The distance between nodes
+	 * @param rng The random stream used to push apart nodes at the same position
+	 * @return Real The magnitude of the force
+	 */
+	Real computeAttrForce(Real distNorm, CounterRng &rng) {
+		if (distNorm == 0) // push the nodes apart slightly 
+			return rng.uniform();
+		// return m_Ks * (dist_norm - m_L) / dist_norm;
+		return m_Ks * distNorm * std::log(distNorm / m_L);
+	}
+
+	/**
+	 * @brief Computes the integral of the repulsive force formula (i.e the energy associated with the force)
+	 * @param distNorm The distance between nodes
+	 * @return Real The integral of the repulsive force formula
+	 */
+	Real computeReplForceIntgr(Real distNorm) {
+		return -m_Kr / distNorm;
+	}
+
+	/**
+	 * @brief Computes the integral of the attractive force formula (i.e the energy associated with the force)
+	 * @param distNorm The distance between nodes
+	 * @return Real The integral of the attractive force formula
+	 */
+	Real computeAttrForceIntgr(Real distNorm) {
+		return (m_Ks / Real(9)) * (distNorm * distNorm * distNorm * (std::log(distNorm / m_L) - 1) + (m_L * m_L * m_L));
+	}
+};
+
+typedef BasicLayoutEngine<float> LayoutEngine;
+typedef BasicLayoutEngine<double> LayoutEngineDouble;
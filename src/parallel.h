@@ -0,0 +1,155 @@
+#pragma once
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/**
+ * @brief Returns the number of threads used by the next parallel region (1 if OpenMP is disabled)
+ */
+inline unsigned int maxThreads() {
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+/**
+ * @brief Returns the id of the calling thread in the current parallel region (0 if OpenMP is disabled)
+ */
+inline unsigned int threadId() {
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+/**
+ * @brief Allocator that leaves the elements uninitialised when a vector is resized (value-initialisation becomes default-initialisation).
+ * The pages of a large array are then first touched, and placed on the NUMA node of the thread that touches them, by the loop that initialises it
+ */
+template <typename T>
+struct FirstTouchAllocator : std::allocator<T> {
+	template <typename U>
+	struct rebind {
+		typedef FirstTouchAllocator<U> other;
+	};
+
+	FirstTouchAllocator() = default;
+
+	template <typename U>
+	FirstTouchAllocator(const FirstTouchAllocator<U> &) {}
+
+	template <typename U>
+	void construct(U *p) noexcept(std::is_nothrow_default_constructible<U>::value) {
+		::new (static_cast<void *>(p)) U;
+	}
+
+	template <typename U, typename... Args>
+	void construct(U *p, Args &&... args) {
+		::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+	}
+};
+
+/**
+ * @brief Per-node array, first touched by the threads that process it (see firstTouch)
+ */
+template <typename T>
+using FirstTouchVector = std::vector<T, FirstTouchAllocator<T>>;
+
+/**
+ * @brief Resizes an array to n elements set to value, each thread setting the elements it processes in the static schedule of the loops over the nodes
+ */
+template <typename T>
+void firstTouch(FirstTouchVector<T> &array, unsigned int n, const T &value) {
+	array.clear();
+	array.resize(n);
+	#pragma omp parallel for schedule(static)
+	for (unsigned int i = 0; i < n; ++i)
+		array[i] = value;
+}
+
+/**
+ * @brief Moves an array to new pages, first touched by the threads that process its elements in the static schedule (e.g. once they are pinned)
+ */
+template <typename T>
+void retouch(FirstTouchVector<T> &array) {
+	FirstTouchVector<T> moved(array.size());
+	#pragma omp parallel for schedule(static)
+	for (unsigned int i = 0; i < array.size(); ++i)
+		moved[i] = array[i];
+	array.swap(moved);
+}
+
+/**
+ * @brief Pins the threads of the parallel regions each to its own CPU, spread evenly over the CPUs allowed to the process, 
+ * so that the threads stay next to the memory they first touched (NUMA) and are shared evenly between the sockets. 
+ * The threads are unpinned by unpin() or the destructor. Only implemented on Linux, does nothing elsewhere
+ */
+class ThreadPinning {
+public:
+	ThreadPinning() : m_pinned(false) {}
+
+	ThreadPinning(const ThreadPinning &) = delete;
+	ThreadPinning &operator=(const ThreadPinning &) = delete;
+
+	~ThreadPinning() {
+		unpin();
+	}
+
+	/**
+	 * @return Whether or not the threads were pinned
+	 */
+	bool pin() {
+#if defined(__linux__) && defined(_OPENMP)
+		if (m_pinned || sched_getaffinity(0, sizeof(m_allowed), &m_allowed) != 0)
+			return m_pinned;
+		std::vector<int> cpus;
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &m_allowed))
+				cpus.push_back(cpu);
+		}
+		unsigned int nbThreads = maxThreads();
+		#pragma omp parallel num_threads(nbThreads)
+		{
+			cpu_set_t own;
+			CPU_ZERO(&own);
+			CPU_SET(cpus[(size_t)threadId() * cpus.size() / nbThreads], &own);
+			sched_setaffinity(0, sizeof(own), &own);
+		}
+		m_pinned = true;
+#endif
+		return m_pinned;
+	}
+
+	/**
+	 * @brief Lets the threads run on all the CPUs allowed to the process before pin()
+	 */
+	void unpin() {
+#if defined(__linux__) && defined(_OPENMP)
+		if (!m_pinned)
+			return;
+		#pragma omp parallel num_threads(maxThreads())
+		sched_setaffinity(0, sizeof(m_allowed), &m_allowed);
+		m_pinned = false;
+#endif
+	}
+
+private:
+	bool m_pinned;
+#ifdef __linux__
+	cpu_set_t m_allowed; // CPUs allowed to the process before pin()
+#endif
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "parallel.h"
+
+/**
+ * @brief Optional instrumentation of the layout algo: wall time of each phase of each iteration, and counters of the work done.
+ * When disabled, each probe costs a single branch. The counters are accumulated per thread, without atomics, and reduced at the end of each iteration.
+ */
+class Profiler {
+public:
+	enum Phase { TREE, SCHEDULE, REPULSION, ATTRACTION, UPDATE, REFINEMENT, EXPORT, NB_PHASES };
+	enum Counter { TREE_VISITS, FAR_FIELD, LEAF_PAIRS, NODES_MOVED, NB_COUNTERS };
+
+	Profiler() : m_enabled(false), m_origin(std::chrono::steady_clock::now()) {}
+
+	/**
+	 * @brief Clears the recorded data and enables or disables the profiler
+	 */
+	void reset(bool enabled) {
+		m_enabled = enabled;
+		m_origin = std::chrono::steady_clock::now();
+		m_events.clear();
+		m_samples.clear();
+		m_threads.assign(enabled ? maxThreads() : 0, ThreadCounters());
+		for (unsigned int p = 0; p < NB_PHASES; ++p)
+			m_phaseTime[p] = 0;
+		for (unsigned int c = 0; c < NB_COUNTERS; ++c)
+			m_total[c] = 0;
+	}
+
+	bool enabled() const {
+		return m_enabled;
+	}
+
+	/**
+	 * @brief Returns the start time of a phase, to give back to end()
+	 */
+	double begin() const {
+		return m_enabled ? now() : 0;
+	}
+
+	/**
+	 * @brief Records a phase that started at begin. Phases may nest (the refinement runs whole iterations)
+	 */
+	void end(Phase phase, double begin) {
+		if (m_enabled) {
+			double end = now();
+			m_events.push_back({phase, begin, end});
+			m_phaseTime[phase] += end - begin;
+		}
+	}
+
+	/**
+	 * @brief Adds n to a counter, may be called from any thread of a parallel region
+	 */
+	void count(Counter counter, uint64_t n = 1) {
+		if (m_enabled)
+			m_threads[threadId()].value[counter] += n;
+	}
+
+	/**
+	 * @brief Reduces the counters of the threads, and records them as the counters of the iteration that just ended
+	 * @param step The id of the iteration
+	 */
+	void endIteration(unsigned int step) {
+		if (!m_enabled)
+			return;
+		CounterSample sample;
+		sample.time = now();
+		sample.step = step;
+		for (unsigned int c = 0; c < NB_COUNTERS; ++c) {
+			sample.value[c] = 0;
+			for (ThreadCounters &t : m_threads) {
+				sample.value[c] += t.value[c];
+				t.value[c] = 0;
+			}
+			m_total[c] += sample.value[c];
+		}
+		m_samples.push_back(sample);
+	}
+
+	/**
+	 * @brief Adds the phase times and the counters of another profiler (e.g. of the engine of a connected component) to the totals of this one.
+	 * Its events and samples are not merged, their timestamps are relative to another origin
+	 */
+	void add(const Profiler &other) {
+		if (!m_enabled)
+			return;
+		for (unsigned int p = 0; p < NB_PHASES; ++p)
+			m_phaseTime[p] += other.m_phaseTime[p];
+		for (unsigned int c = 0; c < NB_COUNTERS; ++c)
+			m_total[c] += other.m_total[c];
+	}
+
+	/**
+	 * @brief Total time spent in a phase, in seconds
+	 */
+	double phaseTime(Phase phase) const {
+		return m_phaseTime[phase] * 1e-6;
+	}
+
+	/**
+	 * @brief Total value of a counter, over the iterations ended so far
+	 */
+	uint64_t total(Counter counter) const {
+		return m_total[counter];
+	}
+
+	static const char *phaseName(Phase phase) {
+		static const char *names[NB_PHASES] = {"tree", "schedule", "repulsion", "attraction", "update", "refinement", "export"};
+		return names[phase];
+	}
+
+	static const char *counterName(Counter counter) {
+		static const char *names[NB_COUNTERS] = {"tree nodes visited", "far-field approximations", "leaf pair interactions", "nodes moved"};
+		return names[counter];
+	}
+
+	/**
+	 * @brief Writes the phases (complete events) and the counters of each iteration (counter events) in the Chrome trace_event JSON format,
+	 * readable by chrome://tracing or Perfetto
+	 * @return Whether or not the file could be written
+	 */
+	bool writeTrace(const std::string &path) const {
+		std::ofstream out(path);
+		if (!out)
+			return false;
+		out << std::fixed << std::setprecision(3); // timestamps in microseconds
+		out << "{\"traceEvents\":[\n";
+		bool first = true;
+		for (const PhaseEvent &e : m_events) {
+			out << (first ? "" : ",\n") << "{\"name\":\"" << phaseName(e.phase) << "\",\"cat\":\"layout\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":"
+				<< e.start << ",\"dur\":" << e.end - e.start << "}";
+			first = false;
+		}
+		for (const CounterSample &s : m_samples) {
+			out << (first ? "" : ",\n") << "{\"name\":\"counters\",\"cat\":\"layout\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":" << s.time << ",\"args\":{\"iteration\":" << s.step;
+			for (unsigned int c = 0; c < NB_COUNTERS; ++c)
+				out << ",\"" << counterName(Counter(c)) << "\":" << s.value[c];
+			out << "}}";
+			first = false;
+		}
+		out << "\n]}\n";
+		return bool(out);
+	}
+
+private:
+	struct PhaseEvent {
+		Phase phase;
+		double start; // In microseconds since the reset of the profiler
+		double end;
+	};
+
+	struct CounterSample {
+		double time; // In microseconds since the reset of the profiler
+		unsigned int step;
+		uint64_t value[NB_COUNTERS];
+	};
+
+	struct alignas(64) ThreadCounters { // a cache line per thread, to avoid false sharing
+		uint64_t value[NB_COUNTERS] = {};
+	};
+
+	bool m_enabled;
+	std::chrono::steady_clock::time_point m_origin; // Time of the last reset
+	std::vector<PhaseEvent> m_events;
+	std::vector<CounterSample> m_samples;
+	std::vector<ThreadCounters> m_threads; // Counters of the current iteration, per thread
+	double m_phaseTime[NB_PHASES]; // Total time of each phase, in microseconds
+	uint64_t m_total[NB_COUNTERS];
+
+	double now() const {
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_origin).count();
+	}
+};
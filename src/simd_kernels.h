@@ -0,0 +1,227 @@
+#pragma once
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Near-field kernels: exact repulsive forces that a block of source nodes (the nodes of a kd-tree leaf) exert on a block of target nodes.
+ * The positions of both blocks are contiguous. A source at the same position as the target (the target itself, or a superposed node) is masked out.
+ * The force of a pair is Kr * d / |d|^2, and the energy of a pair (the integral of the repulsive force evaluated on the force, see CustomLayout) is -|d|.
+ * The results are added to dx, dy and energy (energy may be null).
+ * The kernels exist in float (the fast path, 4 to 16 lanes) and in double (the precise path, for very large coordinate ranges).
+ */
+namespace simd {
+
+template <typename Real>
+using LeafKernel = void (*)(const Real *tx, const Real *ty, unsigned int nbTargets, const Real *sx, const Real *sy, unsigned int nbSources,
+	Real kr, Real *dx, Real *dy, Real *energy);
+
+/**
+ * @brief Interaction of a target with a single source, used by the scalar kernel and the remainders of the vectorized ones
+ */
+template <typename Real>
+inline void pairForce(Real px, Real py, Real sx, Real sy, Real kr, Real &fx, Real &fy, Real &e) {
+	Real distX = px - sx;
+	Real distY = py - sy;
+	Real sqNorm = distX * distX + distY * distY;
+	if (sqNorm > 0) {
+		Real force = kr / sqNorm;
+		fx += distX * force;
+		fy += distY * force;
+		e -= std::sqrt(sqNorm);
+	}
+}
+
+template <typename Real>
+inline void leafForcesScalar(const Real *tx, const Real *ty, unsigned int nbTargets, const Real *sx, const Real *sy, unsigned int nbSources,
+	Real kr, Real *dx, Real *dy, Real *energy) {
+	for (unsigned int t = 0; t < nbTargets; ++t) {
+		Real fx = 0, fy = 0, e = 0;
+		for (unsigned int s = 0; s < nbSources; ++s)
+			pairForce(tx[t], ty[t], sx[s], sy[s], kr, fx, fy, e);
+		dx[t] += fx;
+		dy[t] += fy;
+		if (energy != nullptr)
+			energy[t] += e;
+	}
+}
+
+#ifdef SIMD_KERNELS_X86
+
+__attribute__((target("sse2"))) inline float horizontalSum(__m128 v) {
+	__m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(v, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+__attribute__((target("sse2"))) inline void leafForcesSse(const float *tx, const float *ty, unsigned int nbTargets, const float *sx, const float *sy,
+	unsigned int nbSources, float kr, float *dx, float *dy, float *energy) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 krv = _mm_set1_ps(kr);
+	for (unsigned int t = 0; t < nbTargets; ++t) {
+		__m128 px = _mm_set1_ps(tx[t]);
+		__m128 py = _mm_set1_ps(ty[t]);
+		__m128 fx = zero, fy = zero, e = zero;
+		unsigned int s = 0;
+		for (; s + 4 <= nbSources; s += 4) {
+			__m128 distX = _mm_sub_ps(px, _mm_loadu_ps(sx + s));
+			__m128 distY = _mm_sub_ps(py, _mm_loadu_ps(sy + s));
+			__m128 sqNorm = _mm_add_ps(_mm_mul_ps(distX, distX), _mm_mul_ps(distY, distY));
+			__m128 mask = _mm_cmpgt_ps(sqNorm, zero);
+			__m128 force = _mm_and_ps(mask, _mm_div_ps(krv, sqNorm));
+			fx = _mm_add_ps(fx, _mm_mul_ps(distX, force));
+			fy = _mm_add_ps(fy, _mm_mul_ps(distY, force));
+			e = _mm_sub_ps(e, _mm_and_ps(mask, _mm_sqrt_ps(sqNorm)));
+		}
+		float fxs = horizontalSum(fx), fys = horizontalSum(fy), es = horizontalSum(e);
+		for (; s < nbSources; ++s)
+			pairForce(tx[t], ty[t], sx[s], sy[s], kr, fxs, fys, es);
+		dx[t] += fxs;
+		dy[t] += fys;
+		if (energy != nullptr)
+			energy[t] += es;
+	}
+}
+
+__attribute__((target("avx2,fma"))) inline float horizontalSum(__m256 v) {
+	__m128 sums = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	__m128 shuf = _mm_movehdup_ps(sums);
+	sums = _mm_add_ps(sums, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+__attribute__((target("avx2,fma"))) inline void leafForcesAvx2(const float *tx, const float *ty, unsigned int nbTargets, const float *sx, const float *sy,
+	unsigned int nbSources, float kr, float *dx, float *dy, float *energy) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 krv = _mm256_set1_ps(kr);
+	for (unsigned int t = 0; t < nbTargets; ++t) {
+		__m256 px = _mm256_set1_ps(tx[t]);
+		__m256 py = _mm256_set1_ps(ty[t]);
+		__m256 fx = zero, fy = zero, e = zero;
+		unsigned int s = 0;
+		for (; s + 8 <= nbSources; s += 8) {
+			__m256 distX = _mm256_sub_ps(px, _mm256_loadu_ps(sx + s));
+			__m256 distY = _mm256_sub_ps(py, _mm256_loadu_ps(sy + s));
+			__m256 sqNorm = _mm256_fmadd_ps(distX, distX, _mm256_mul_ps(distY, distY));
+			__m256 mask = _mm256_cmp_ps(sqNorm, zero, _CMP_GT_OQ);
+			__m256 force = _mm256_and_ps(mask, _mm256_div_ps(krv, sqNorm));
+			fx = _mm256_fmadd_ps(distX, force, fx);
+			fy = _mm256_fmadd_ps(distY, force, fy);
+			e = _mm256_sub_ps(e, _mm256_and_ps(mask, _mm256_sqrt_ps(sqNorm)));
+		}
+		float fxs = horizontalSum(fx), fys = horizontalSum(fy), es = horizontalSum(e);
+		for (; s < nbSources; ++s)
+			pairForce(tx[t], ty[t], sx[s], sy[s], kr, fxs, fys, es);
+		dx[t] += fxs;
+		dy[t] += fys;
+		if (energy != nullptr)
+			energy[t] += es;
+	}
+}
+
+__attribute__((target("avx2,fma"))) inline double horizontalSum(__m256d v) {
+	__m128d sums = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(sums, _mm_unpackhi_pd(sums, sums)));
+}
+
+__attribute__((target("avx2,fma"))) inline void leafForcesAvx2(const double *tx, const double *ty, unsigned int nbTargets, const double *sx, const double *sy,
+	unsigned int nbSources, double kr, double *dx, double *dy, double *energy) {
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d krv = _mm256_set1_pd(kr);
+	for (unsigned int t = 0; t < nbTargets; ++t) {
+		__m256d px = _mm256_set1_pd(tx[t]);
+		__m256d py = _mm256_set1_pd(ty[t]);
+		__m256d fx = zero, fy = zero, e = zero;
+		unsigned int s = 0;
+		for (; s + 4 <= nbSources; s += 4) {
+			__m256d distX = _mm256_sub_pd(px, _mm256_loadu_pd(sx + s));
+			__m256d distY = _mm256_sub_pd(py, _mm256_loadu_pd(sy + s));
+			__m256d sqNorm = _mm256_fmadd_pd(distX, distX, _mm256_mul_pd(distY, distY));
+			__m256d mask = _mm256_cmp_pd(sqNorm, zero, _CMP_GT_OQ);
+			__m256d force = _mm256_and_pd(mask, _mm256_div_pd(krv, sqNorm));
+			fx = _mm256_fmadd_pd(distX, force, fx);
+			fy = _mm256_fmadd_pd(distY, force, fy);
+			e = _mm256_sub_pd(e, _mm256_and_pd(mask, _mm256_sqrt_pd(sqNorm)));
+		}
+		double fxs = horizontalSum(fx), fys = horizontalSum(fy), es = horizontalSum(e);
+		for (; s < nbSources; ++s)
+			pairForce(tx[t], ty[t], sx[s], sy[s], kr, fxs, fys, es);
+		dx[t] += fxs;
+		dy[t] += fys;
+		if (energy != nullptr)
+			energy[t] += es;
+	}
+}
+
+__attribute__((target("avx512f"))) inline float horizontalSum(__m512 v) {
+	// the masked forms avoid the undefined sources of the unmasked intrinsics
+	v = _mm512_add_ps(v, _mm512_maskz_shuffle_f32x4(0xFFFF, v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm512_add_ps(v, _mm512_maskz_shuffle_f32x4(0xFFFF, v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return horizontalSum(_mm512_maskz_extractf32x4_ps(0xF, v, 0));
+}
+
+__attribute__((target("avx512f"))) inline void leafForcesAvx512(const float *tx, const float *ty, unsigned int nbTargets, const float *sx, const float *sy,
+	unsigned int nbSources, float kr, float *dx, float *dy, float *energy) {
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 krv = _mm512_set1_ps(kr);
+	for (unsigned int t = 0; t < nbTargets; ++t) {
+		__m512 px = _mm512_set1_ps(tx[t]);
+		__m512 py = _mm512_set1_ps(ty[t]);
+		__m512 fx = zero, fy = zero, e = zero;
+		for (unsigned int s = 0; s < nbSources; s += 16) {
+			__mmask16 lanes = nbSources - s >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (nbSources - s)) - 1);
+			__m512 distX = _mm512_maskz_sub_ps(lanes, px, _mm512_maskz_loadu_ps(lanes, sx + s));
+			__m512 distY = _mm512_maskz_sub_ps(lanes, py, _mm512_maskz_loadu_ps(lanes, sy + s));
+			__m512 sqNorm = _mm512_fmadd_ps(distX, distX, _mm512_mul_ps(distY, distY));
+			__mmask16 mask = _mm512_mask_cmp_ps_mask(lanes, sqNorm, zero, _CMP_GT_OQ);
+			__m512 force = _mm512_maskz_div_ps(mask, krv, sqNorm);
+			fx = _mm512_fmadd_ps(distX, force, fx);
+			fy = _mm512_fmadd_ps(distY, force, fy);
+			e = _mm512_sub_ps(e, _mm512_maskz_sqrt_ps(mask, sqNorm));
+		}
+		dx[t] += horizontalSum(fx);
+		dy[t] += horizontalSum(fy);
+		if (energy != nullptr)
+			energy[t] += horizontalSum(e);
+	}
+}
+
+#endif
+
+/**
+ * @brief Returns the widest kernel supported by the CPU: AVX-512, AVX2, SSE, or the scalar one on other architectures (AVX2 or scalar in double)
+ */
+template <typename Real>
+LeafKernel<Real> selectLeafKernel();
+
+template <>
+inline LeafKernel<float> selectLeafKernel<float>() {
+#ifdef SIMD_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return leafForcesAvx512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return leafForcesAvx2;
+	if (__builtin_cpu_supports("sse2"))
+		return leafForcesSse;
+#endif
+	return leafForcesScalar<float>;
+}
+
+template <>
+inline LeafKernel<double> selectLeafKernel<double>() {
+#ifdef SIMD_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return leafForcesAvx2;
+#endif
+	return leafForcesScalar<double>;
+}
+
+}
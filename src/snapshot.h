@@ -0,0 +1,114 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Double-buffered publication of the positions of a running layout to a reader thread.
+ * The layout copies the positions into the back buffer and goes on, the reader thread swaps it with the front buffer and gives it to the callback.
+ * The layout never waits for the callback: while the reader is busy, a new snapshot replaces the one that is not read yet.
+ */
+template <typename Real>
+class SnapshotPublisher {
+public:
+	typedef std::function<void(const std::vector<Real> &x, const std::vector<Real> &y, unsigned int step)> Callback;
+
+	SnapshotPublisher() : m_front(0), m_pending(false), m_quit(false) {}
+
+	SnapshotPublisher(const SnapshotPublisher &) = delete;
+	SnapshotPublisher &operator=(const SnapshotPublisher &) = delete;
+
+	~SnapshotPublisher() {
+		stop();
+	}
+
+	bool running() const {
+		return m_reader.joinable();
+	}
+
+	/**
+	 * @brief Starts the reader thread, which calls callback with each snapshot
+	 */
+	void start(const Callback &callback) {
+		stop();
+		m_callback = callback;
+		m_pending = false;
+		m_quit = false;
+		m_reader = std::thread(&SnapshotPublisher::readLoop, this);
+	}
+
+	/**
+	 * @brief Copies the positions into the back buffer, they are read as soon as the reader is free. Only waits for the reader to swap the buffers
+	 * @param x, y The positions of the n nodes
+	 * @param step The id of the iteration
+	 * @param ids If not null, the position of node k is written at index ids[k] of the snapshot (the nodes are renumbered)
+	 */
+	void publish(const Real *x, const Real *y, unsigned int n, unsigned int step, const unsigned int *ids = nullptr) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			Buffer &back = m_buffers[1 - m_front];
+			if (ids) {
+				back.x.resize(n);
+				back.y.resize(n);
+				for (unsigned int k = 0; k < n; ++k) {
+					back.x[ids[k]] = x[k];
+					back.y[ids[k]] = y[k];
+				}
+			} else {
+				back.x.assign(x, x + n);
+				back.y.assign(y, y + n);
+			}
+			back.step = step;
+			m_pending = true;
+		}
+		m_wakeUp.notify_one();
+	}
+
+	/**
+	 * @brief Reads the pending snapshot, if any, and stops the reader thread
+	 */
+	void stop() {
+		if (!m_reader.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_wakeUp.notify_one();
+		m_reader.join();
+	}
+
+private:
+	struct Buffer {
+		std::vector<Real> x;
+		std::vector<Real> y;
+		unsigned int step = 0;
+	};
+
+	Buffer m_buffers[2];
+	unsigned int m_front; // Index of the buffer read by the callback, the other one is written by publish
+	bool m_pending; // Whether or not the back buffer holds a snapshot that is not read yet
+	bool m_quit;
+	Callback m_callback;
+	std::mutex m_mutex; // Guards the back buffer, m_front, m_pending and m_quit
+	std::condition_variable m_wakeUp;
+	std::thread m_reader;
+
+	void readLoop() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true) {
+			m_wakeUp.wait(lock, [this]() { return m_pending || m_quit; });
+			if (!m_pending)
+				return;
+			m_front = 1 - m_front;
+			m_pending = false;
+			lock.unlock();
+			const Buffer &front = m_buffers[m_front];
+			m_callback(front.x, front.y, front.step);
+			lock.lock();
+		}
+	}
+};